@@ -9,60 +9,84 @@
 #include <iterator>
 #include <functional>
 
-#define HALT    99
-#define ADD     1
-#define MULT    2 
+#include "intcode_sweep.hpp"
+#include "intcode_symbolic.hpp"
+#include "intcode_constexpr.hpp"
 
-int part1(int noun, int verb,  std::map < int, std::function<int(int, int)> >& map, std::vector<int> intCode)
+// The puzzle input is a valid initializer list
+constexpr long long IMAGE[] = {
+#include "day02.txt"
+};
+
+// Position 0 after the program ran with noun and verb, evaluated while
+// compiling when both are constants
+constexpr long long part1(long long noun, long long verb)
 {
-    // initialize opcodes
-    intCode[1] = noun;
-    intCode[2] = verb;
+    IntcodeConstexpr<sizeof(IMAGE) / sizeof(IMAGE[0])> ic(IMAGE);
+    ic.setMemory(1, noun);
+    ic.setMemory(2, verb);
+    ic.run({});
+    return ic.getMemory(0);
+}
 
-    int i = 0;
-    while (i < intCode.size())
-    {
-        // assume index is at operation code
-        if (intCode[i] == HALT)
-            break;
+// The same on IntcodeComputer, with the backend from $INTCODE_BACKEND
+long long part1(const std::vector<long long>& intCode, long long noun, long long verb)
+{
+    IntcodeComputer ic(intCode);
+    ic.setVerbosity(false);
+    ic.setMemory(1, noun);
+    ic.setMemory(2, verb);
+    ic.run();
+    return ic.getMemory(0);
+}
 
-        // Do the operation
-        intCode[ intCode[i+3] ] = map[intCode[i]] (
-                intCode[ intCode[i+1] ], 
-                intCode[ intCode[i+2] ]);
-        i += 4;
-    }
+// Every noun/verb pair is a job of the sweep, the first pair giving the
+// expected output wins
+std::pair<int, int> sweepPart2(const std::vector<long long>& image)
+{
+    std::vector<IntcodeSweep::Patch> jobs;
+    for (int noun = 0; noun < 100; noun++)
+    for (int verb = 0; verb < 100; verb++)
+        jobs.push_back(IntcodeSweep::Patch { {1, noun}, {2, verb} });
+
+    IntcodeSweep sweep(image);
+    auto result = sweep.find(jobs, [](IntcodeComputer& ic) { return ic.getMemory(0) == 19690720; });
+    if (!result.found())
+        return std::pair<int, int> (-1, -1);
 
-    return intCode[0];
+    std::printf("Sweep ran %llu of %zu jobs in %.3f ms\n", result.jobsRun, jobs.size(), 1000 * result.seconds);
+    return std::pair<int, int> (result.job / 100, result.job % 100);
 }
 
-std::pair<int, int> part2(std::map < int, std::function<int(int, int)> >& map, std::vector<int> intCode)
+// Position 0 as a polynomial of noun and verb, solved for the expected
+// output. Programs that branch on noun or verb fall back to the sweep.
+std::pair<int, int> part2(const std::vector<long long>& image)
 {
-    for (int i = 0; i <= 99; i++)
-        for (int j = 0; j <=99; j++)
-            if (part1(i, j, map, intCode) == 19690720)
-                return std::pair<int, int> (i, j);
+    IntcodeSymbolic symbolic(image, {1, 2});
+    if (!symbolic.run() || !symbolic.isResolved(0))
+    {
+        std::cout << "No closed form (" << (symbolic.getFailure().empty() ? symbolic.whyUnresolved(0) : symbolic.getFailure())
+            << "), sweeping" << std::endl;
+        return sweepPart2(image);
+    }
 
-    return std::pair<int, int> (-1, -1);
+    std::cout << "Position 0 is " << symbolic.value(0).toString() << std::endl;
+    auto solution = IntcodeSymbolic::solve(symbolic.value(0), 19690720, { {1, 0, 99}, {2, 0, 99} });
+    if (!solution)
+        return std::pair<int, int> (-1, -1);
+    return std::pair<int, int> (solution->at(1), solution->at(2));
 }
 
 int main ()
 {
-    std::fstream inputFile("day02.txt");
-    std::string line, token;
-    getline(inputFile, line);
-
-    std::vector<int> intCode;
-    std::stringstream ss(line);
-    while (getline(ss, token, ','))
-        intCode.push_back(std::stoi(token));
+    std::vector<long long> intCode = IntcodeLoader::loadFile("day02.txt");
 
-    std::map < int, std::function<int(int, int)> > operationsMap;
-    operationsMap.emplace(ADD, [](int a, int b) { return a+b; } );
-    operationsMap.emplace(MULT, [](int a, int b) { return a*b; } );
-    
-    std::cout << "Position 0 (part1) is: " << part1(12, 2, operationsMap, intCode) << std::endl;
-    auto sol = part2(operationsMap, intCode);
+    constexpr long long expected = part1(12, 2);
+    const long long position0 = part1(intCode, 12, 2);
+    if (position0 != expected)
+        throw std::runtime_error("IntcodeComputer disagrees with the constexpr machine on day02");
+    std::cout << "Position 0 (part1) is: " << position0 << std::endl;
+    auto sol = part2(intCode);
     std::printf("Part2 solution is %d\n", 100 * sol.first + sol.second);
     return 0;
 }
\ No newline at end of file
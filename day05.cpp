@@ -9,94 +9,69 @@
 #include <iterator>
 #include <functional>
 
-#define HALT    99
-#define ADD     1
-#define MULT    2
-#define INPUT   3
-#define OUTPUT  4
-#define JUMP_IF_TRUE 5
-#define JUMP_IF_FALSE 6
-#define LESS_THAN 7
-#define EQUALS 8
+#include "intcode_computer.hpp"
+#include "intcode_constexpr.hpp"
 
-#define POSITION_MODE 0
-#define IMMEDIATE_MODE 1
+constexpr long long IMAGE[] = {
+#include "day05.txt"
+};
 
-void part1(std::map < int, std::function<int(int, int)> >& map, std::vector<int> intCode)
+// Diagnostic code the test ends with for a system ID, evaluated while compiling
+constexpr long long diagnosticCode(long long systemId)
 {
-    int i = 0;
-    while (i < intCode.size())
-    {
-        int paramMode3 = intCode[i] / 10000,
-            paramMode2 = (intCode[i] % 10000) / 1000,
-            paramMode1 = (intCode[i] % 1000 ) / 100,
-            opCode = intCode[i] % 100;
+    IntcodeConstexpr<sizeof(IMAGE) / sizeof(IMAGE[0])> ic(IMAGE);
+    ic.run({systemId});
+    return ic.lastOutput();
+}
 
-        // assume index is at operation code
-        if (opCode == HALT)
-            break;
+// Every output before the diagnostic code is a test, 0 when it passed
+constexpr bool testsPass(long long systemId)
+{
+    IntcodeConstexpr<sizeof(IMAGE) / sizeof(IMAGE[0])> ic(IMAGE);
+    ic.run({systemId});
+    for (size_t i = 0; i + 1 < ic.outputCount(); i++)
+        if (ic.output(i) != 0)
+            return false;
+    return ic.outputCount() > 0;
+}
 
-        if (opCode == INPUT)
-        {
-            int input;
-            std::cout << "Please give an input: ";
-            std::cin >> input;
-            std::cout << std::endl;
-            if (paramMode1 == POSITION_MODE) intCode[ intCode[i+1] ] = input;
-            else intCode[i+1] = input;
-            i += 2;
-        }
-        else if (opCode == OUTPUT)
-        {
-            int output;
-            if (paramMode1 == POSITION_MODE) output = intCode[ intCode[i+1] ];
-            else output = intCode[i+1];
-            std::cout << "DIAGNOSTICS output: " << output << std::endl;
-            i += 2;
-        }
-        else if (opCode == JUMP_IF_TRUE || opCode == JUMP_IF_FALSE)
-        {
-            int firstArg = paramMode1 == POSITION_MODE ? intCode[ intCode[i+1] ] : intCode[i+1];
-            int secondArg = paramMode2 == POSITION_MODE ? intCode[ intCode[i+2] ] : intCode[i+2];
-            
-            if (opCode == JUMP_IF_TRUE && firstArg != 0 ||
-                opCode == JUMP_IF_FALSE && firstArg == 0)
-                i = secondArg;
-            else
-                i += 3;
-        }
-        else
-        {
-            int firstArgIndex = paramMode1 == POSITION_MODE ? intCode[i+1] : i+1;
-            int secondArgIndex = paramMode2 == POSITION_MODE ? intCode[i+2] : i+2;
-            int resultIndex = paramMode3 == POSITION_MODE ? intCode[i+3] : i+3;
+static_assert(testsPass(1) && testsPass(5), "day05 diagnostics fail on the constexpr machine");
 
-            //std::printf("Indices [%d, %d, %d]\n", firstArgIndex, secondArgIndex, resultIndex);
-            // Do the operation
-            intCode[ resultIndex ] = map[opCode] (
-                intCode[ firstArgIndex ], intCode[ secondArgIndex ]);
-            i += 4;
-        }
+// The same on IntcodeComputer, with the backend from $INTCODE_BACKEND
+long long diagnosticCode(const std::vector<long long>& intCode, long long systemId)
+{
+    IntcodeComputer ic(intCode);
+    ic.setVerbosity(false);
+    ic.pushInput(systemId);
+    ic.run();
+    long long code = -1;
+    while (ic.hasOutput())
+        code = ic.popOutput();
+    return code;
+}
+
+// Asks for the system ID when the program reads it, the computer prints the outputs
+void part1(const std::vector<long long>& intCode)
+{
+    IntcodeComputer ic(intCode);
+    while (ic.run() == IntcodeComputer::StopReason::NEED_INPUT)
+    {
+        long long input = 0;
+        std::cout << "Please give an input: ";
+        std::cin >> input;
+        std::cout << std::endl;
+        ic.pushInput(input);
     }
 }
 
 int main ()
 {
-    std::fstream inputFile("day05.txt");
-    std::string line, token;
-    getline(inputFile, line);
-
-    std::vector<int> intCode;
-    std::stringstream ss(line);
-    while (getline(ss, token, ','))
-        intCode.push_back(std::stoi(token));
-
-    std::map < int, std::function<int(int, int)> > operationsMap;
-    operationsMap.emplace(ADD, [](int a, int b) { return a+b; } );
-    operationsMap.emplace(MULT, [](int a, int b) { return a*b; } );
-    operationsMap.emplace(LESS_THAN, [](int a, int b) { return a < b ? 1 : 0; } );
-    operationsMap.emplace(EQUALS, [](int a, int b) { return a == b ? 1 : 0; } );
+    const std::vector<long long> intCode = IntcodeLoader::loadFile("day05.txt");
+    const long long airConditioner = diagnosticCode(intCode, 1), thermalRadiators = diagnosticCode(intCode, 5);
+    if (airConditioner != diagnosticCode(1) || thermalRadiators != diagnosticCode(5))
+        throw std::runtime_error("IntcodeComputer disagrees with the constexpr machine on day05");
+    std::cout << "Diagnostic code for system 1: " << airConditioner << ", for system 5: " << thermalRadiators << std::endl;
 
-    part1(operationsMap, intCode);
+    part1(intCode);
     return 0;
 }
\ No newline at end of file
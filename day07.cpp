@@ -12,212 +12,74 @@
 #include <math.h>
 #include <array>
 
-#define HALT            99
-#define ADD             1
-#define MULT            2
-#define INPUT           3
-#define OUTPUT          4
-#define JUMP_IF_TRUE    5
-#define JUMP_IF_FALSE   6
-#define LESS_THAN       7
-#define EQUALS          8
+#include "intcode_scheduler.hpp"
 
-#define POSITION_MODE   0
-#define IMMEDIATE_MODE  1
-
-class Amplifier
+// Five amplifiers on the scheduler, with feedback the last amplifier's
+// output loops back into the first one. The fleet is built once and reset
+// for every phase setting.
+class Amplifiers
 {
 public:
-    Amplifier(std::vector<int> intCode, std::map < int, std::function<int(int, int)> > map, int index)
-        :_intCode(intCode), _intCodeOrig(intCode), _map(map), _index(index) { }
-        
-    void reset()
-    {
-        _intCode = std::vector<int> (_intCodeOrig);
-        _intructionPointer = 0;
-        _halted = false;
-        _lastOutput = -1;
-    }
-
-    int amplify(int ampInput, int ampPhase)
+    Amplifiers(const std::vector<long long>& intCode, bool feedback)
     {
-        return amplify_internal(ampInput, ampPhase, _intCode, false, true);
+        IntcodeComputer amp(intCode);
+        amp.setVerbosity(false);
+        for (int i = 0; i < 5; i++)
+            _scheduler.add(amp);
+        for (int i = 0; i < 4; i++)
+            _scheduler.connect(i, i + 1);
+        if (feedback)
+            _scheduler.connect(4, 0);
     }
 
-    int amplifySingle(int ampInput)
+    // Each amplifier reads its phase first
+    long long run(const std::array<int, 5>& phases)
     {
-        return amplify_internal(ampInput, -1, _intCode, true, true);
+        _scheduler.reset();
+        for (int i = 0; i < 5; i++)
+            _scheduler.send(i, phases[i]);
+        _scheduler.send(0, 0);
+        _scheduler.run();
+
+        // Whatever the last amplifier sent after the first one halted
+        std::vector<long long> thrust = _scheduler.receive(4);
+        if (thrust.empty())
+            throw std::runtime_error("Amplifiers halted without producing a thrust");
+        return thrust.back();
     }
 
-    int getLastOutput() { return _lastOutput; }
-
-    bool isHalted() { return _halted; }
-    
 private:
-
-    int amplify_internal(int ampInput, int ampPhase, std::vector<int> intCode, bool phaseSet = false, bool returnOutput = false)
-    {
-        int output = -1;
-        bool outputSet = false;
-        //std::printf ("Amp input %d, Amp phase %d\n", ampInput, ampPhase);
-        while (_intructionPointer < _intCode.size())
-        {
-            int paramMode3 = _intCode[_intructionPointer] / 10000,
-                paramMode2 = (_intCode[_intructionPointer] % 10000) / 1000,
-                paramMode1 = (_intCode[_intructionPointer] % 1000 ) / 100,
-                opCode = _intCode[_intructionPointer] % 100;
-
-            // assume index is at operation code
-            if (opCode == HALT)
-            {
-                _halted = true;
-                // std::printf("Amplifier %d halted.", _index);
-                break;
-            }
-
-            if (opCode == INPUT)
-            {
-                int input = phaseSet ? ampInput : ampPhase;
-                phaseSet = true;
-                // std::cout << "Current input is: " << input << std::endl;
-                if (paramMode1 == POSITION_MODE) _intCode[ _intCode[_intructionPointer+1] ] = input;
-                else _intCode[_intructionPointer+1] = input;
-                _intructionPointer += 2;
-            }
-            else if (opCode == OUTPUT)
-            {
-                if (paramMode1 == POSITION_MODE) output = _intCode[ _intCode[_intructionPointer+1] ];
-                else output = _intCode[_intructionPointer+1];
-                // std::cout << "DIAGNOSTICS output: " << output << std::endl;
-                _intructionPointer += 2;
-                outputSet = true;
-
-                if (returnOutput)
-                    break;
-            }
-            else if (opCode == JUMP_IF_TRUE || opCode == JUMP_IF_FALSE)
-            {
-                int firstArg = paramMode1 == POSITION_MODE ? _intCode[ _intCode[_intructionPointer+1] ] : _intCode[_intructionPointer+1];
-                int secondArg = paramMode2 == POSITION_MODE ? _intCode[ _intCode[_intructionPointer+2] ] : _intCode[_intructionPointer+2];
-                
-                if (opCode == JUMP_IF_TRUE && firstArg != 0 ||
-                    opCode == JUMP_IF_FALSE && firstArg == 0)
-                    _intructionPointer = secondArg;
-                else
-                    _intructionPointer += 3;
-            }
-            else
-            {
-                int firstArgIndex = paramMode1 == POSITION_MODE ? _intCode[_intructionPointer+1] : _intructionPointer+1;
-                int secondArgIndex = paramMode2 == POSITION_MODE ? _intCode[_intructionPointer+2] : _intructionPointer+2;
-                int resultIndex = paramMode3 == POSITION_MODE ? _intCode[_intructionPointer+3] : _intructionPointer+3;
-
-                //std::printf("Indices [%d, %d, %d]\n", firstArgIndex, secondArgIndex, resultIndex);
-                // Do the operation
-                _intCode[ resultIndex ] = _map[opCode] (
-                    _intCode[ firstArgIndex ], _intCode[ secondArgIndex ]);
-                _intructionPointer += 4;
-            }
-        }
-
-        if (outputSet)
-            _lastOutput = output;
-        return output;
-    }
-
-    int _index = -1;
-    int _lastOutput = -1;
-    bool _halted = false;
-    int _intructionPointer = 0;
-    std::vector<int> _intCode;
-    const std::vector<int> _intCodeOrig;
-    std::map < int, std::function<int(int, int)> > _map;
+    // Five VMs depending on each other, more threads only add overhead
+    IntcodeScheduler _scheduler {1};
 };
 
-int part1(std::vector<int> totalInput, std::vector<Amplifier>& amps)
+long long calcMax(const std::vector<long long>& intCode)
 {
-    int i = 0;
-    int ampInput = 0;
-    while (i < 5)
-    {
-        ampInput = amps[i].amplify(ampInput, totalInput[i]);
-        i++;
-    }
-    return ampInput;
-}
-
-int part2(std::vector<int> phaseInput, std::vector<Amplifier>& amps)
-{
-    int i = 0;
-    int ampInput = 0;
-    bool firstPass = true;
-    bool allHalted = true;
-    do {
-        allHalted = true;
-        i = 0;
-        while (i < 5)
-        {
-            if (firstPass) ampInput = amps[i].amplify(ampInput, phaseInput[i]);
-            else ampInput = amps[i].amplifySingle(ampInput);
-            allHalted = allHalted && amps.at(i).isHalted();
-            // std::cout << std::endl;
-            i++;
-        }
-        firstPass = false;
-    } while (!allHalted);
-
-    return amps.at(4).getLastOutput();
-}
-
-int calcMax(std::vector<Amplifier>& amps)
-{
-    int max = 0;
+    Amplifiers amplifiers(intCode, false);
+    long long max = 0;
     std::array<int, 5> perm = {0, 1, 2, 3, 4};
     do {
-        max = std::max(max, part1(std::vector<int> {perm[0], perm[1], perm[2], perm[3], perm[4]}, amps));
-        for (auto& amp : amps)
-            amp.reset();
+        max = std::max(max, amplifiers.run(perm));
     } while (std::next_permutation(perm.begin(), perm.end()));
     return max;
 }
 
-int calcMaxFeedBack(std::vector<Amplifier>& amps)
+long long calcMaxFeedBack(const std::vector<long long>& intCode)
 {
+    Amplifiers amplifiers(intCode, true);
     std::array<int, 5> perm = {5, 6, 7, 8, 9};
-    int max = 0;
+    long long max = 0;
     do {
-        max = std::max(max, part2(std::vector<int> {perm[0], perm[1], perm[2], perm[3], perm[4]}, amps));
-        for (auto& amp : amps)
-            amp.reset();
+        max = std::max(max, amplifiers.run(perm));
     } while (std::next_permutation(perm.begin(), perm.end()));
     return max;
 }
 
 int main () 
 {
-    std::fstream inputFile("day07.txt");
-    std::string line, token;
-    getline(inputFile, line);
-
-    std::vector<int> intCode;
-    std::stringstream ss(line);
-    while (getline(ss, token, ','))
-        intCode.push_back(std::stoi(token));
-
-    std::map < int, std::function<int(int, int)> > operationsMap;
-    operationsMap.emplace(ADD, [](int a, int b) { return a+b; } );
-    operationsMap.emplace(MULT, [](int a, int b) { return a*b; } );
-    operationsMap.emplace(LESS_THAN, [](int a, int b) { return a < b ? 1 : 0; } );
-    operationsMap.emplace(EQUALS, [](int a, int b) { return a == b ? 1 : 0; } );
+    std::vector<long long> intCode = IntcodeLoader::loadFile("day07.txt");
 
-    std::vector<Amplifier> amps;
-    amps.push_back(Amplifier(intCode, operationsMap, 1));
-    amps.push_back(Amplifier(intCode, operationsMap, 2));
-    amps.push_back(Amplifier(intCode, operationsMap, 3));
-    amps.push_back(Amplifier(intCode, operationsMap, 4));
-    amps.push_back(Amplifier(intCode, operationsMap, 5));
-    
-    std::cout << "Max thruster:\n" << calcMax(amps) << std::endl;
-    std::cout << "Max thruster feedback:\n" << calcMaxFeedBack(amps) << std::endl;
+    std::cout << "Max thruster:\n" << calcMax(intCode) << std::endl;
+    std::cout << "Max thruster feedback:\n" << calcMaxFeedBack(intCode) << std::endl;
     return 0; 
 }
\ No newline at end of file
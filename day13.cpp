@@ -18,195 +18,7 @@
 #include <cmath>
 
 #include "my_macros.hpp"
-
-class IntcodeComputer
-{
-
-enum Opcode 
-{
-    HALT            = 99,
-    ADD             = 1,
-    MULT            = 2,
-    INPUT           = 3,
-    OUTPUT          = 4,
-    JUMP_IF_TRUE    = 5,
-    JUMP_IF_FALSE   = 6,
-    LESS_THAN       = 7,
-    EQUALS          = 8,
-    BASE_OP         = 9
-};
-
-enum ParameterMode 
-{
-    POSITION_MODE   = 0,
-    IMMEDIATE_MODE  = 1,
-    RELATIVE_MODE   = 2
-};
-
-public:
-    IntcodeComputer(std::vector<long long> intCode)
-        :_intCode(intCode), _intCodeOrig(intCode) 
-    {
-        _operationsMap.emplace(ADD, [](long long a, long long b) { return a+b; } );
-        _operationsMap.emplace(MULT, [](long long a, long long b) { return a*b; } );
-        _operationsMap.emplace(LESS_THAN, [](long long a, long long b) { return a < b ? 1 : 0; } );
-        _operationsMap.emplace(EQUALS, [](long long a, long long b) { return a == b ? 1 : 0; } );
-    }
-    
-    void reset()
-    {
-    int i = 0;
-        _intCode = std::vector<long long> (_intCodeOrig);
-        _instructionPointer = 0;
-        _halted = false;
-        _lastOutput = -1;
-        _relativeBase = 0;
-    }
-
-    int calculate()
-    {
-        return calculate_internal(-1, _intCode, false, true);
-    }
-
-    int calculateSingle()
-    {
-        return calculate_internal(-1, _intCode, true, true);
-    }
-
-    int calculateSingle(int input)
-    {
-        return calculate_internal(input, _intCode, true, false);
-    }
-
-    std::pair<int, int> calcDoubleOutput(int input)
-    {
-        int first = calculate_internal(input, _intCode, true, false);
-        int second = calculate_internal(input, _intCode, true, false);
-        return std::make_pair(first, second);
-    }
-
-    int getLastOutput() { return _lastOutput; }
-
-    bool isHalted() { return _halted; }
-    
-private:
-
-    void setMemoryVal(long long index, long long value)
-    {
-        while (index > _intCode.size() - 1)
-            _intCode.push_back(0);    
-        _intCode[index] = value; 
-    }
-
-    long long getMemoryVal(long long index)
-    {
-        while (index > _intCode.size() - 1)
-            _intCode.push_back(0);    
-        return _intCode[index];
-    }
-
-    int getArgIndex(int paramMode, int index)
-    {
-        switch (paramMode)
-        {    
-            case POSITION_MODE:
-                return getMemoryVal(index);                
-
-            case IMMEDIATE_MODE:
-                return index;
-
-            case RELATIVE_MODE:
-                return _relativeBase + getMemoryVal(index);
-            
-            default:
-                return -1;
-        }; 
-    }
-
-    int calculate_internal(int input, std::vector<long long> intCode, bool returnOnOutput = false, bool takeUserInput = false)
-    {
-        long long output = -1;
-        bool outputSet = false;
-        //std::printf ("Amp input %d, Amp phase %d\n", ampInput, ampPhase);
-        while (_instructionPointer < _intCode.size())
-        {   
-            int paramMode3 = _intCode[_instructionPointer] / 10000,
-                paramMode2 = (_intCode[_instructionPointer] % 10000) / 1000,
-                paramMode1 = (_intCode[_instructionPointer] % 1000 ) / 100,
-                opCode = _intCode[_instructionPointer] % 100;
-
-            // assume index is at operation code
-            if (opCode == HALT)
-            {
-                _halted = true;
-                std::printf("Computer halted\n");
-                break;
-            }
-
-            if (opCode == INPUT)
-            {   
-                if (takeUserInput)
-                {
-                    LOG("Please input number: ");
-                    std::cin >> input;
-                }
-
-                std::cout << "Current input is: " << input << std::endl;
-                setMemoryVal(  getArgIndex(paramMode1, _instructionPointer + 1), input);
-                _instructionPointer += 2;
-            }
-            else if (opCode == OUTPUT)
-            {
-                output = getMemoryVal( getArgIndex(paramMode1, _instructionPointer + 1) );
-                // std::cout << "DIAGNOSTICS output: " << output << std::endl;
-                _instructionPointer += 2;
-                outputSet = true;
-                if (returnOnOutput)
-                    break;
-            }
-            else if (opCode == BASE_OP)
-            {
-                _relativeBase += getMemoryVal( getArgIndex(paramMode1, _instructionPointer + 1) );
-                _instructionPointer += 2;
-            }
-            else if (opCode == JUMP_IF_TRUE || opCode == JUMP_IF_FALSE)
-            {
-                int firstArg = getMemoryVal( getArgIndex(paramMode1, _instructionPointer + 1) );
-                int secondArg = getMemoryVal( getArgIndex(paramMode2, _instructionPointer + 2) );
-                
-                if (opCode == JUMP_IF_TRUE && firstArg != 0 ||
-                    opCode == JUMP_IF_FALSE && firstArg == 0)
-                    _instructionPointer = secondArg;
-                else
-                    _instructionPointer += 3;
-            }
-            else
-            {
-                int firstArgIndex = getArgIndex(paramMode1, _instructionPointer + 1),
-                    secondArgIndex = getArgIndex(paramMode2, _instructionPointer + 2),
-                    resultIndex = getArgIndex(paramMode3, _instructionPointer + 3);
-
-                //std::printf("Indices [%d, %d, %d]\n", firstArgIndex, secondArgIndex, resultIndex);
-                // Do the operation
-                setMemoryVal(resultIndex, 
-                    _operationsMap[opCode] (
-                        getMemoryVal( firstArgIndex ), getMemoryVal( secondArgIndex )
-                    ));
-                _instructionPointer += 4;
-            }
-        }
-
-        if (outputSet)
-            _lastOutput = output;
-        return output;
-    }
-
-    int _index = -1, _lastOutput = -1, _instructionPointer = 0, _relativeBase = 0;
-    bool _halted = false;
-    std::vector<long long> _intCode;
-    const std::vector<long long> _intCodeOrig;
-    std::map < long long, std::function<long long(long long, long long)> > _operationsMap;
-};
+#include "intcode_computer.hpp"
 
 namespace game_ns 
 {
@@ -240,65 +52,56 @@ namespace game_ns
 
 int main ()
 {
-    std::fstream inputFile("day13.txt");
-    std::string line, token;
-    getline(inputFile, line);
-
-    std::vector<long long> intCode;
-    std::stringstream ss(line);
-    while (getline(ss, token, ',')) intCode.push_back(std::stoll(token));
+    std::vector<long long> intCode = IntcodeLoader::loadFile("day13.txt");
 
     IntcodeComputer ic(intCode);
-    std::map< std::pair<int, int>, int> gameMap;
+    ic.setVerbosity(false);
+    ic.run();
+
+    // Screen updates come in (x, y, id) triples
     int blockCount = 0;
-    while (!ic.isHalted())
+    while (ic.outputSize() >= 3)
     {
-        int x = ic.calculateSingle(),
-            y = ic.calculateSingle(),
-            id = ic.calculateSingle();
-
-        if (id < 0) break;
-        if (id == 2) blockCount++;
+        // Position first, only the tile id matters here
+        ic.popOutput();
+        ic.popOutput();
+        if (ic.popOutput() == 2) blockCount++;
     }
     std::printf("There are %d block tiles on screen.\n", blockCount);
 
     intCode[0] = 2;
     IntcodeComputer ic2(intCode);
+    ic2.setVerbosity(false);
     std::array< std::array<char, 43>, 26 > gameGrid {0};
     const std::string clear( 100, '\n' ) ;
 
     int score = 0;
-    int player_input = 0, ball_x = -1, paddle_x = -1;
+    int ball_x = -1, paddle_x = -1;
     unsigned int microseconds = 5000;
-    while(!ic2.isHalted())
+    while (true)
     {
-        int x = ic2.calculateSingle(player_input),   
-            y = ic2.calculateSingle(player_input),
-            id = ic2.calculateSingle(player_input);
-        
-        if (id < 0) break;
+        // Run until the game asks for the joystick, then take in the whole frame
+        IntcodeComputer::StopReason reason = ic2.run();
+        while (ic2.outputSize() >= 3)
+        {
+            int x = ic2.popOutput(),
+                y = ic2.popOutput(),
+                id = ic2.popOutput();
 
-        // Update ball and paddle positions
-        if (id == game_ns::ObjectId::HORIZONTAL_PADDLE_ID)
-            paddle_x = x;
-        if (id == game_ns::ObjectId::BALL_ID)
-            ball_x = x;
+            if (x == -1 && y == 0) 
+            {
+                score = id;
+                continue;   
+            }
 
-        if (paddle_x >= 0 && ball_x >= 0)
-        {
-            if (paddle_x == ball_x)
-                player_input = 0;
-            else 
-                player_input = ball_x - paddle_x > 0 ? 1 : -1;
-        }
+            // Update ball and paddle positions
+            if (id == game_ns::ObjectId::HORIZONTAL_PADDLE_ID)
+                paddle_x = x;
+            if (id == game_ns::ObjectId::BALL_ID)
+                ball_x = x;
 
-        if (x == -1 && y == 0) 
-        {
-            score = id;
-            continue;   
+            gameGrid[y][x] = game_ns::objectMap.at(id);
         }
-
-        gameGrid[y][x] = game_ns::objectMap.at(id);
         //std::cout << clear;
         //std::printf("SCORE : %d\n", score);
         //for (auto &line : gameGrid)
@@ -307,6 +110,12 @@ int main ()
         //    std::cout << std::endl;
         //}
         //usleep(microseconds);
+
+        if (reason != IntcodeComputer::StopReason::NEED_INPUT) break;
+        int player_input = 0;
+        if (paddle_x != ball_x)
+            player_input = ball_x - paddle_x > 0 ? 1 : -1;
+        ic2.pushInput(player_input);
     }
     std::cout << "Score is: " << score << std::endl;
 }
\ No newline at end of file
@@ -1,10 +1,11 @@
-#include "intcode_computer.hpp"
+#include "intcode_coroutine.hpp"
 #include <fstream>
 #include <iostream>
 #include <unordered_map>
 #include <vector>
 #include <unistd.h>
 #include <unordered_set>
+#include <deque>
 
 // A hash function used to hash a pair of any kind 
 struct hash_pair { 
@@ -55,14 +56,6 @@ enum Direction
     EAST = 4
 };
 
-Direction getOppositeDirection(int dir)
-{
-    if (dir == Direction::NORTH) return Direction::SOUTH;
-    if (dir == Direction::SOUTH) return Direction::NORTH;
-    if (dir == Direction::EAST) return Direction::WEST;
-    if (dir == Direction::WEST) return Direction::EAST;
-}
-
 std::pair<int, int> movePosition(const std::pair<int, int>& currentPosition, int direction)
 {
     int xOff = 0, yOff = 0;
@@ -135,102 +128,60 @@ void printMatrixMap(const std::pair<int, int>& pos, bool enableDroid = true)
     usleep(5000);
 }
 
-int getNewMovement(const std::pair<int, int>& pos, const int& prevMovement)
+void connect(const std::pair<int, int>& first, const std::pair<int, int>& second)
 {
-    // Go to a new position that is not yet discovered
-    for (int movementDir = Direction::NORTH; movementDir <= 4; movementDir++)
-    {
-        auto newPos = movePosition(pos, movementDir);
-        if (gridMap.find(newPos) == gridMap.end()) return movementDir;
-    }
-
-    // If all are discovered return same movement direction if that direction is free
-    // if (gridMap.find(movePosition(pos, prevMovement))->second != TileValues::WALL) return prevMovement;
-
-    // Return any free direction as long as its not opposite to previous
-    std::vector<int> dirs;
-    for (int movementDir = Direction::NORTH; movementDir <= 4; movementDir++)
-    {
-        auto newPos = movePosition(pos, movementDir);
-        auto it = gridMap.find(newPos);
-        if (it->second != TileValues::WALL &&
-            getOppositeDirection(prevMovement) != movementDir) 
-                dirs.push_back(movementDir);
-    }
-    if (!dirs.empty()) return dirs[rand() % dirs.size()];
-
-
-    // Return any other movement direction that contains a free block
-    dirs.clear();
-    for (int movementDir = Direction::NORTH; movementDir <= 4; movementDir++)
-    {
-        auto newPos = movePosition(pos, movementDir);
-        auto it = gridMap.find(newPos);
-        if (it->second != TileValues::WALL) dirs.push_back(movementDir);
-    }
-    return dirs[rand() % dirs.size()];    
+    connectivityMap[first].emplace(second);
+    connectivityMap[second].emplace(first);
 }
 
 const std::pair<int, int> getOxygenPosition()
 {
-    std::pair<int, int> currentPosition {0, 0},
+    std::pair<int, int> startPosition {0, 0},
         oxyPosition {0, 0};
-    gridMap.emplace(currentPosition, TileValues::FREE);
+    gridMap.emplace(startPosition, TileValues::FREE);
     matrixMap.push_back( std::vector<char> {tileMap[TileValues::FREE]} );
 
-    int movementDir = Direction::EAST;
-    char currentTileValue = TileValues::FREE;
-    int movesUntilNewArea = 0;
-    bool foundOxy = false;
-    while (movesUntilNewArea < 500 || !foundOxy) // currentTileValue != TileValues::OXY)
-    {  
-        if (currentTileValue == TileValues::OXY)
-        {
-            foundOxy = true;
-            oxyPosition = currentPosition;
-        }
-
-        //std::printf("Dir: %d [%d, %d] -> %d\n", movementDir, currentPosition.first, currentPosition.second, currentTileValue);
-        int newTileValue = ic.calculateSingle(movementDir);
-        if (ic.isHalted()) break;
-        auto newPos = movePosition(currentPosition, movementDir);
-        updateMatrixMap(newPos, newTileValue);
+    // Breadth first over the droid states, every position keeps a snapshot of
+    // the droid standing on it so each neighbour is probed with a single move
+    std::deque< std::pair< std::pair<int, int>, IntcodeComputer::Snapshot > > frontier;
+    frontier.emplace_back(startPosition, ic.snapshot());
+    IntcodeCoroutine droidProgram = IntcodeCoroutine::start(ic);
+    while (!frontier.empty())
+    {
+        auto currentPosition = frontier.front().first;
+        auto droid = std::move(frontier.front().second);
+        frontier.pop_front();
 
-        // Insert new grid position
-        auto success = gridMap.emplace(newPos, newTileValue);
-        // If insertion is not successful, this means we have already seen this area
-        if (!success.second)
-            movesUntilNewArea++;
-        else
-            movesUntilNewArea = 0;
-        
-        //std::printf("Found: [%d, %d] -> %d\n", newPos.first, newPos.second, newTileValue);
-        printMatrixMap(currentPosition);
-        
-        // Check if position is valid
-        if (!success.second && gridMap[newPos] != newTileValue)
-            throw std::runtime_error("Inconsistent tiles ...");
-        
-        // Movement was successful
-        if (newTileValue != TileValues::WALL)
+        for (int movementDir = Direction::NORTH; movementDir <= 4; movementDir++)
         {
-            // Single link
-            auto success = connectivityMap.emplace(
-                currentPosition, std::unordered_set<std::pair<int, int>, hash_pair> {newPos});
-            if (!success.second)
-                connectivityMap[currentPosition].emplace(newPos);
-
-            // Double link
-            success = connectivityMap.emplace(
-                newPos, std::unordered_set< std::pair<int, int>, hash_pair> {currentPosition});
-            if (!success.second)
-                connectivityMap[newPos].emplace(currentPosition);
+            auto newPos = movePosition(currentPosition, movementDir);
+            auto known = gridMap.find(newPos);
+            if (known != gridMap.end())
+            {
+                // Already explored, only a link may be missing
+                if (known->second != TileValues::WALL)
+                    connect(currentPosition, newPos);
+                continue;
+            }
+
+            ic.restore(droid);
+            droidProgram.input(movementDir);
+            auto reply = droidProgram.output();
+            if (!reply)
+                throw std::runtime_error("Droid stopped answering during exploration");
+            int newTileValue = *reply;
+
+            gridMap.emplace(newPos, newTileValue);
+            updateMatrixMap(newPos, newTileValue);
+            if (newTileValue == TileValues::WALL)
+                continue;
 
-            currentPosition = newPos;
-            currentTileValue = newTileValue;
+            connect(currentPosition, newPos);
+            if (newTileValue == TileValues::OXY)
+                oxyPosition = newPos;
+            frontier.emplace_back(newPos, ic.snapshot());
         }
-        
-        movementDir = getNewMovement(currentPosition, movementDir);
+        printMatrixMap(currentPosition);
     }
     return oxyPosition;
 }
@@ -0,0 +1,390 @@
+#ifndef INTCODE_BATCH_HPP
+#define INTCODE_BATCH_HPP
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include "intcode_instruction_set.hpp"
+#include "intcode_ring_buffer.hpp"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Runs LANES instances of one program in lockstep. Memory is laid out as
+// structure of arrays, cell c of every lane sits in LANES consecutive words,
+// so an operand is fetched for all lanes with one vector load (AVX2, four
+// lanes per register, build with -mavx2).
+//
+// Every step executes the instruction at the lowest instruction pointer for
+// all lanes standing on it whose instruction word and address operands match,
+// the other lanes wait. Lanes that took different branches run on their own
+// until their instruction pointers meet again. Nothing is cached between steps,
+// so lanes modifying their own code need no extra care. A lane reaching an
+// unknown opcode or an invalid address faults and stops, the others go on.
+template <int LANES = 4>
+class IntcodeBatch : private IntcodeInstructionSet
+{
+    static_assert(LANES > 0 && LANES <= 32, "Lane masks are 32 bit");
+#if defined(__AVX2__)
+    static_assert(LANES % 4 == 0, "AVX2 lanes come in groups of four");
+#endif
+
+public:
+    static constexpr long long MAX_CELLS = 1 << 22; // Per lane
+
+    struct Stats
+    {
+        unsigned long long steps = 0;               // Instructions issued for a group of lanes
+        unsigned long long laneInstructions = 0;    // Instructions executed summed over lanes
+        unsigned long long divergentSteps = 0;      // Steps leaving some runnable lane out
+
+        double utilization() const { return steps > 0 ? (double) laneInstructions / (steps * LANES) : 0; }
+    };
+
+    explicit IntcodeBatch(const std::vector<long long>& image)
+        :_image(image)
+    {
+        reset();
+    }
+
+    // Every lane back to the image
+    void reset()
+    {
+        _cells = std::max<long long>(_image.size(), 1);
+        _memory.assign(_cells * LANES, 0);
+        for (size_t c = 0; c < _image.size(); c++) {
+            std::fill_n(&_memory[c * LANES], LANES, _image[c]);
+        }
+        std::fill_n(_ip, LANES, 0);
+        std::fill_n(_relativeBase, LANES, 0);
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            _input[lane].clear();
+            _output[lane].clear();
+        }
+        _halted = _blocked = _faulted = 0;
+    }
+
+    long long get(int lane, long long address)
+    {
+        return address >= 0 && address < _cells ? _memory[address * LANES + lane] : 0;
+    }
+
+    void set(int lane, long long address, long long value)
+    {
+        _memory[reserve(address) * LANES + lane] = value;
+    }
+
+    void pushInput(int lane, long long value)
+    {
+        _input[lane].push(value);
+        _blocked &= ~(1u << lane);
+    }
+
+    bool hasOutput(int lane) { return !_output[lane].empty(); }
+    long long popOutput(int lane) { return _output[lane].pop(); }
+
+    bool isHalted(int lane) { return (_halted >> lane) & 1; }
+    bool isWaitingForInput(int lane) { return (_blocked >> lane) & 1; }
+    bool isFaulted(int lane) { return (_faulted >> lane) & 1; }
+
+    // Runs until every lane halted, faulted or waits for input
+    void run()
+    {
+        while (step()) { }
+    }
+
+    Stats getStats() { return _stats; }
+
+private:
+
+    static constexpr unsigned ALL_LANES = LANES == 32 ? ~0u : (1u << LANES) - 1;
+
+    long long* cell(long long address) { return &_memory[address * LANES]; }
+
+    long long reserve(long long address)
+    {
+        if (address < 0) {
+            throw std::runtime_error("Access to negative address " + std::to_string(address));
+        }
+        if (address >= _cells)
+        {
+            if (address >= MAX_CELLS) {
+                throw std::runtime_error("Address " + std::to_string(address) + " is outside of the batch memory");
+            }
+            _cells = std::min(MAX_CELLS, std::max(address + 1, 2 * _cells));
+            _memory.resize(_cells * LANES, 0);
+        }
+        return address;
+    }
+
+    // Cell the operand is read from (or written to), the same for all lanes of the group
+    long long operandAddress(const DecodedInstruction& instr, int i, long long ip, int leader)
+    {
+        switch (instr.modes[i])
+        {
+            case POSITION_MODE:
+                return reserve(cell(ip + 1 + i)[leader]);
+
+            case IMMEDIATE_MODE:
+                return reserve(ip + 1 + i);
+
+            default:
+                return reserve(_relativeBase[leader] + cell(ip + 1 + i)[leader]);
+        };
+    }
+
+    // Lanes at ip that agree with the leader on the instruction word and on
+    // every cell an address is formed from
+    unsigned lockstepGroup(unsigned group, const DecodedInstruction& instr, long long ip, int leader)
+    {
+        const long long word = cell(ip)[leader];
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            if (!((group >> lane) & 1)) {
+                continue;
+            }
+            bool same = cell(ip)[lane] == word;
+            for (int i = 0; same && i < instr.length - 1; i++)
+            {
+                if (instr.modes[i] == IMMEDIATE_MODE) {
+                    continue;
+                }
+                same = cell(ip + 1 + i)[lane] == cell(ip + 1 + i)[leader] &&
+                    (instr.modes[i] != RELATIVE_MODE || _relativeBase[lane] == _relativeBase[leader]);
+            }
+            if (!same) {
+                group &= ~(1u << lane);
+            }
+        }
+        return group;
+    }
+
+    bool step()
+    {
+        const unsigned runnable = ALL_LANES & ~_halted & ~_blocked & ~_faulted;
+        if (runnable == 0) {
+            return false;
+        }
+
+        long long ip = _ip[__builtin_ctz(runnable)];
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            if (((runnable >> lane) & 1) && _ip[lane] < ip) {
+                ip = _ip[lane];
+            }
+        }
+        unsigned group = 0;
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            if (((runnable >> lane) & 1) && _ip[lane] == ip) {
+                group |= 1u << lane;
+            }
+        }
+
+        const int leader = __builtin_ctz(group);
+        DecodedInstruction instr;
+        if (ip < 0 || ip >= _cells || !decodeWord(cell(ip)[leader], instr) || ip + instr.length > MAX_CELLS)
+        {
+            _faulted |= 1u << leader;
+            return true;
+        }
+        reserve(ip + instr.length - 1);
+        group = lockstepGroup(group, instr, ip, leader);
+
+        _stats.steps++;
+        _stats.laneInstructions += __builtin_popcount(group);
+        if (group != runnable) {
+            _stats.divergentSteps++;
+        }
+
+        // Every address is formed before anything is written, a fault leaves the lanes untouched
+        try {
+            execute(instr, ip, leader, group);
+        }
+        catch (const std::runtime_error&) {
+            _faulted |= group;
+        }
+        return true;
+    }
+
+    void execute(const DecodedInstruction& instr, long long ip, int leader, unsigned group)
+    {
+        switch (instr.opCode)
+        {
+            case ADD: case MULT: case LESS_THAN: case EQUALS:
+            {
+                const long long a = operandAddress(instr, 0, ip, leader),
+                    b = operandAddress(instr, 1, ip, leader),
+                    target = operandAddress(instr, 2, ip, leader);
+                arithmetic(instr.opCode, cell(a), cell(b), cell(target), group);
+                advance(group, 4);
+                break;
+            }
+
+            case JUMP_IF_TRUE: case JUMP_IF_FALSE:
+            {
+                const long long conditionAddress = operandAddress(instr, 0, ip, leader),
+                    targetAddress = operandAddress(instr, 1, ip, leader);
+                const long long* condition = cell(conditionAddress);
+                const long long* target = cell(targetAddress);
+                for (int lane = 0; lane < LANES; lane++)
+                {
+                    if ((group >> lane) & 1) {
+                        _ip[lane] = (condition[lane] != 0) == (instr.opCode == JUMP_IF_TRUE) ? target[lane] : ip + 3;
+                    }
+                }
+                break;
+            }
+
+            case BASE_OP:
+            {
+                const long long* value = cell(operandAddress(instr, 0, ip, leader));
+                for (int lane = 0; lane < LANES; lane++)
+                {
+                    if ((group >> lane) & 1) {
+                        _relativeBase[lane] += value[lane];
+                    }
+                }
+                advance(group, 2);
+                break;
+            }
+
+            case INPUT:
+            {
+                long long* target = cell(operandAddress(instr, 0, ip, leader));
+                for (int lane = 0; lane < LANES; lane++)
+                {
+                    if (!((group >> lane) & 1)) {
+                        continue;
+                    }
+                    if (_input[lane].empty())
+                    {
+                        _blocked |= 1u << lane;
+                        continue;
+                    }
+                    target[lane] = _input[lane].pop();
+                    _ip[lane] += 2;
+                }
+                break;
+            }
+
+            case OUTPUT:
+            {
+                const long long* value = cell(operandAddress(instr, 0, ip, leader));
+                for (int lane = 0; lane < LANES; lane++)
+                {
+                    if ((group >> lane) & 1) {
+                        _output[lane].push(value[lane]);
+                    }
+                }
+                advance(group, 2);
+                break;
+            }
+
+            default:
+                _halted |= group;
+                break;
+        };
+    }
+
+    void advance(unsigned group, int length)
+    {
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            if ((group >> lane) & 1) {
+                _ip[lane] += length;
+            }
+        }
+    }
+
+    // target[lane] = a[lane] op b[lane] for the lanes in group. Sources are
+    // read before the store, they may be the target cell.
+    static void arithmetic(int opCode, const long long* a, const long long* b, long long* target, unsigned group)
+    {
+#if defined(__AVX2__)
+        const __m256i laneBits = _mm256_setr_epi64x(1, 2, 4, 8);
+        for (int k = 0; k < LANES; k += 4)
+        {
+            const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k)),
+                y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k));
+            __m256i result;
+            switch (opCode)
+            {
+                case ADD:
+                    result = _mm256_add_epi64(x, y);
+                    break;
+
+                case MULT:
+                    result = multiply(x, y);
+                    break;
+
+                case LESS_THAN:
+                    result = _mm256_srli_epi64(_mm256_cmpgt_epi64(y, x), 63);
+                    break;
+
+                default:
+                    result = _mm256_srli_epi64(_mm256_cmpeq_epi64(x, y), 63);
+                    break;
+            };
+
+            const __m256i mask = _mm256_cmpeq_epi64(
+                _mm256_and_si256(_mm256_set1_epi64x((group >> k) & 15), laneBits), laneBits);
+            _mm256_maskstore_epi64(reinterpret_cast<long long*>(target + k), mask, result);
+        }
+#else
+        long long result[LANES];
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            switch (opCode)
+            {
+                case ADD:
+                    result[lane] = (long long) ((unsigned long long) a[lane] + (unsigned long long) b[lane]);
+                    break;
+
+                case MULT:
+                    result[lane] = (long long) ((unsigned long long) a[lane] * (unsigned long long) b[lane]);
+                    break;
+
+                case LESS_THAN:
+                    result[lane] = a[lane] < b[lane] ? 1 : 0;
+                    break;
+
+                default:
+                    result[lane] = a[lane] == b[lane] ? 1 : 0;
+                    break;
+            };
+        }
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            if ((group >> lane) & 1) {
+                target[lane] = result[lane];
+            }
+        }
+#endif
+    }
+
+#if defined(__AVX2__)
+    // Low 64 bits of the product, AVX2 only multiplies 32 bit halves
+    static __m256i multiply(__m256i x, __m256i y)
+    {
+        const __m256i low = _mm256_mul_epu32(x, y);
+        const __m256i cross = _mm256_add_epi64(
+            _mm256_mul_epu32(_mm256_srli_epi64(x, 32), y),
+            _mm256_mul_epu32(x, _mm256_srli_epi64(y, 32)));
+        return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+    }
+#endif
+
+    const std::vector<long long> _image;
+    std::vector<long long> _memory;     // Cell c of lane l at c * LANES + l
+    long long _cells = 0;
+    long long _ip[LANES];
+    long long _relativeBase[LANES];
+    unsigned _halted = 0, _blocked = 0, _faulted = 0;
+    IntcodeRingBuffer<long long> _input[LANES], _output[LANES];
+    Stats _stats;
+};
+
+#endif /* INTCODE_BATCH_HPP */
@@ -0,0 +1,688 @@
+#include "intcode_computer.hpp"
+#include "intcode_batch.hpp"
+#include "intcode_scheduler.hpp"
+#include "intcode_sweep.hpp"
+#include "intcode_symbolic.hpp"
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <array>
+#include <sstream>
+#include <cstdint>
+#include <cstdio>
+
+typedef IntcodeComputer::Backend Backend;
+
+// Generate with: intcode_translate intcode_bench_loop.txt intcode_bench_loop_native.hpp
+#if __has_include("intcode_bench_loop_native.hpp")
+#include "intcode_bench_loop_native.hpp"
+#define HAVE_BENCH_LOOP_NATIVE 1
+#endif
+
+std::vector<long long> loadProgram(const std::string& fileName)
+{
+    return IntcodeLoader::loadFile(fileName);
+}
+
+struct BenchResult
+{
+    unsigned long long instructions = 0;
+    double seconds = 0;
+    long long lastOutput = -1;
+    unsigned long long fused = 0;   // Instructions entered through a fused handler instead of a dispatch
+    unsigned long long codeWrites = 0;
+    unsigned long long nativeDisabled = 0;  // Translated blocks switched off by code writes
+    size_t pages = 0;               // Pages touched by the last run
+};
+
+BenchResult runProgram(const std::vector<long long>& intCode, Backend backend, int repeats,
+    const IntcodeNative::Program* native)
+{
+    IntcodeComputer ic(intCode);
+    ic.setVerbosity(false);
+    ic.setBackend(backend);
+    if (native != nullptr) ic.setNativeProgram(*native);
+
+    BenchResult result;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++)
+    {
+        ic.reset();
+        while (ic.run() == IntcodeComputer::StopReason::NEED_INPUT) ic.pushInput(0);
+        while (ic.hasOutput()) result.lastOutput = ic.popOutput();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    result.instructions = ic.getInstructionCount();
+    result.seconds = std::chrono::duration<double>(end - begin).count();
+    IntcodeComputer::FusionStats fusion = ic.getFusionStats();
+    result.fused = fusion.compareJump + fusion.addCompare;
+    result.codeWrites = ic.getInvalidationStats().codeWrites;
+    result.nativeDisabled = ic.getInvalidationStats().nativeDisabled;
+    result.pages = ic.getPagesTouched();
+    return result;
+}
+
+void compareBackends(const std::string& name, const std::vector<long long>& intCode, int repeats,
+    const IntcodeNative::Program* native = nullptr)
+{
+    std::vector< std::pair<std::string, Backend> > backends {
+        {"reference", Backend::REFERENCE},
+        {"predecoded", Backend::PREDECODED},
+        {"threaded", Backend::THREADED},
+        {"jit", Backend::JIT}
+    };
+    if (native != nullptr) backends.emplace_back("native", Backend::NATIVE);
+
+    std::printf("%s (%d runs)\n", name.c_str(), repeats);
+    double referenceIps = 0;
+    for (auto& backend : backends)
+    {
+        BenchResult result = runProgram(intCode, backend.second, repeats, native);
+        double ips = result.instructions / result.seconds;
+        if (backend.second == Backend::REFERENCE) referenceIps = ips;
+        std::printf("  %-12s %12llu instr %8.3f s %10.2f Minstr/s  x%.2f  fused %5.1f%%  code writes %llu  pages %zu  (last output %lld)\n",
+            backend.first.c_str(), result.instructions, result.seconds,
+            ips / 1e6, ips / referenceIps, 100.0 * result.fused / result.instructions,
+            result.codeWrites, result.pages, result.lastOutput);
+        if (backend.second == Backend::NATIVE) {
+            std::printf("  %-12s %llu translated blocks switched off\n", "", result.nativeDisabled);
+        }
+    }
+}
+
+// Next input from the outputs so far, for the programs that talk to a driver
+typedef std::function<long long(const std::vector<long long>&)> InputPolicy;
+
+struct OptimizerRun
+{
+    unsigned long long instructions = 0;
+    double seconds = 0;
+    std::vector<long long> outputs;
+    unsigned long long deoptimized = 0;
+};
+
+// Runs the program until it halts or maxInputs inputs were consumed
+OptimizerRun runWithPolicy(const std::vector<long long>& intCode, Backend backend, bool optimize, int repeats,
+    const InputPolicy& policy, int maxInputs)
+{
+    IntcodeComputer ic(intCode);
+    ic.setVerbosity(false);
+    ic.setBackend(backend);
+    ic.setOptimizer(optimize);
+
+    OptimizerRun result;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++)
+    {
+        ic.reset();
+        result.outputs.clear();
+        int inputs = 0;
+        while (ic.run() == IntcodeComputer::StopReason::NEED_INPUT && inputs++ < maxInputs)
+        {
+            while (ic.hasOutput()) result.outputs.push_back(ic.popOutput());
+            ic.pushInput(policy(result.outputs));
+        }
+        while (ic.hasOutput()) result.outputs.push_back(ic.popOutput());
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    result.instructions = ic.getInstructionCount();
+    result.deoptimized = ic.getInvalidationStats().deoptimized;
+    return result;
+}
+
+// Interpreting backends with and without the load-time optimizer, outputs have to match
+bool compareOptimizer(const std::string& name, const std::vector<long long>& intCode, int repeats,
+    const InputPolicy& policy, int maxInputs = 1000000)
+{
+    IntcodeComputer probe(intCode);
+    probe.setOptimizer(true);
+    IntcodeOptimizer::Stats stats = probe.getOptimizerStats();
+    std::printf("%s (%d runs): %zu of %zu instructions optimized, %zu operands folded (%zu propagated), "
+        "%zu constant cells, %zu jumps decided\n", name.c_str(), repeats, stats.optimized, stats.instructions,
+        stats.foldedOperands, stats.propagatedOperands, stats.constantCells, stats.decidedJumps);
+
+    bool same = true;
+    for (auto& backend : { std::make_pair("predecoded", Backend::PREDECODED), std::make_pair("threaded", Backend::THREADED) })
+    {
+        OptimizerRun plain = runWithPolicy(intCode, backend.second, false, repeats, policy, maxInputs);
+        OptimizerRun optimized = runWithPolicy(intCode, backend.second, true, repeats, policy, maxInputs);
+        bool matches = plain.outputs == optimized.outputs && plain.instructions == optimized.instructions;
+        same = same && matches;
+        std::printf("  %-12s %12llu instr %8.3f s -> %8.3f s  x%.2f  deoptimized %llu  outputs %zu %s\n",
+            backend.first, optimized.instructions, plain.seconds, optimized.seconds, plain.seconds / optimized.seconds,
+            optimized.deoptimized, optimized.outputs.size(), matches ? "match" : "DIFFER");
+    }
+    return same;
+}
+
+// Small programs with a known output, each one once got a backend wrong
+struct Regression
+{
+    std::string name;
+    std::vector<long long> intCode;
+    std::vector<long long> inputs;
+    std::vector<long long> outputs;
+    std::vector<long long> warmUp = {};     // Inputs of a run on the same computer before the reset and the checked run
+};
+
+std::vector<Regression> regressions()
+{
+    return {
+        // Writes code past its image and jumps there
+        { "code past the image", {1101, 0, 104, 200, 1101, 0, 42, 201, 1101, 0, 104, 202, 1101, 0, 7, 203,
+            1101, 0, 99, 204, 1105, 1, 200}, {}, {42, 7} },
+        { "jump to a computed address", {3, 50, 1005, 50, 12, 1101, 5, 5, 100, 4, 100, 99,
+            1101, 4, 5, 101, 105, 1, 101}, {1}, {0} },
+        // Runs code it wrote before anything decoded it, the reset has to bring back the image's instruction
+        { "code written before its first run", {3, 100, 1006, 100, 9, 1101, 0, 104, 9, 4, 12, 99, 77}, {0}, {77}, {1} },
+    };
+}
+
+// Every backend with and without the optimizer has to give the expected outputs
+bool checkRegressions()
+{
+    bool same = true;
+    for (auto& regression : regressions())
+    for (Backend backend : {Backend::REFERENCE, Backend::PREDECODED, Backend::THREADED, Backend::JIT})
+    for (bool optimize : {false, true})
+    {
+        IntcodeComputer ic(regression.intCode);
+        ic.setVerbosity(false);
+        ic.setBackend(backend);
+        ic.setOptimizer(optimize);
+        std::vector<long long> outputs;
+        try
+        {
+            if (!regression.warmUp.empty())
+            {
+                ic.pushInputs(regression.warmUp);
+                ic.run();
+                ic.reset();
+            }
+            ic.pushInputs(regression.inputs);
+            ic.run();
+            while (ic.hasOutput()) outputs.push_back(ic.popOutput());
+        }
+        catch (const std::exception& e) {
+            std::printf("  %s: %s\n", regression.name.c_str(), e.what());
+        }
+        if (outputs != regression.outputs)
+        {
+            std::printf("%s: wrong outputs on %s%s\n", regression.name.c_str(), IntcodeComputer::backendName(backend),
+                optimize ? " with the optimizer" : "");
+            same = false;
+        }
+    }
+    return same;
+}
+
+// Puzzle programs driven by an input policy in place of their day driver
+struct Workload
+{
+    std::string name;
+    std::vector<long long> intCode;
+    int repeats;
+    InputPolicy policy;
+    int maxInputs = 1000000;
+};
+
+std::vector<long long> patched(std::vector<long long> intCode, long long address, long long value)
+{
+    intCode[address] = value;
+    return intCode;
+}
+
+std::vector<Workload> workloads()
+{
+    std::vector<Workload> programs;
+    programs.push_back({"day05", loadProgram("day05.txt"), 20000, [](const std::vector<long long>&) { return 5; }});
+    programs.push_back({"day09", loadProgram("day09.txt"), 20000, [](const std::vector<long long>&) { return 0; }});
+    // Robot sees a colour derived from the moves so far
+    programs.push_back({"day11", loadProgram("day11.txt"), 2000, [](const std::vector<long long>& outputs)
+    {
+        return (long long) (outputs.size() / 2 % 3 == 0);
+    }});
+    // Plays the game with the paddle following the ball
+    programs.push_back({"day13", patched(loadProgram("day13.txt"), 0, 2), 20,
+        [seen = (size_t) 0, ball = 0LL, paddle = 0LL](const std::vector<long long>& outputs) mutable
+    {
+        if (outputs.size() < seen) seen = 0;
+        for (; seen + 2 < outputs.size(); seen += 3)
+        {
+            if (outputs[seen + 2] == 4) ball = outputs[seen];
+            if (outputs[seen + 2] == 3) paddle = outputs[seen];
+        }
+        return (long long) ((ball > paddle) - (ball < paddle));
+    }});
+    // Droid wanders in a fixed pseudo random walk, the program never halts
+    programs.push_back({"day15", loadProgram("day15.txt"), 20, [](const std::vector<long long>& outputs)
+    {
+        unsigned long long x = outputs.size() * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (long long) (x >> 62) + 1;
+    }, 20000});
+    return programs;
+}
+
+// Every workload on every interpreting and compiling backend, outputs have to
+// match the reference interpreter's
+bool compareWorkloads(const std::vector<Workload>& programs)
+{
+    bool same = true;
+    for (auto& workload : programs)
+    {
+        std::printf("%s (%d runs)\n", workload.name.c_str(), workload.repeats);
+        OptimizerRun reference;
+        for (Backend backend : {Backend::REFERENCE, Backend::PREDECODED, Backend::THREADED, Backend::JIT})
+        {
+            OptimizerRun run = runWithPolicy(workload.intCode, backend, false, workload.repeats, workload.policy, workload.maxInputs);
+            if (backend == Backend::REFERENCE) reference = run;
+            bool matches = run.outputs == reference.outputs && run.instructions == reference.instructions;
+            same = same && matches;
+            std::printf("  %-12s %12llu instr %8.3f s %10.2f Minstr/s  x%.2f  outputs %zu %s\n",
+                IntcodeComputer::backendName(backend), run.instructions, run.seconds, run.instructions / run.seconds / 1e6,
+                reference.seconds / run.seconds, run.outputs.size(), matches ? "match" : "DIFFER");
+        }
+    }
+    return same;
+}
+
+// Text loader throughput on a generated program of the given size, against
+// the getline and std::stoll loop it replaced
+void compareTextLoaders(size_t cells)
+{
+    const std::string fileName = "intcode_bench_large.txt";
+    {
+        std::ofstream out(fileName);
+        unsigned long long x = 1;
+        for (size_t i = 0; i < cells; i++)
+        {
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            long long value = (long long) (x >> 40) - (1LL << 23);
+            out << (i ? "," : "") << (i % 4 == 0 ? value % 30000 : value);
+        }
+        out << "\n";
+    }
+    std::ifstream sizeProbe(fileName, std::ios::binary | std::ios::ate);
+    const double megabytes = sizeProbe.tellg() / 1e6;
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<long long> previous;
+    {
+        std::fstream inputFile(fileName);
+        std::string line, token;
+        getline(inputFile, line);
+        std::stringstream ss(line);
+        while (getline(ss, token, ',')) previous.push_back(std::stoll(token));
+    }
+    auto middle = std::chrono::steady_clock::now();
+    std::vector<long long> loaded = IntcodeLoader::loadFile(fileName);
+    auto end = std::chrono::steady_clock::now();
+    std::remove(fileName.c_str());
+
+    double before = std::chrono::duration<double>(middle - begin).count(),
+        after = std::chrono::duration<double>(end - middle).count();
+    std::printf("text loader, %.1f MB: getline/stoll %.1f MB/s, IntcodeLoader %.1f MB/s  x%.2f%s\n", megabytes,
+        megabytes / before, megabytes / after, before / after, loaded == previous ? "" : "  (cells differ)");
+}
+
+// Text parsed by IntcodeComputer(std::fstream&&) against the binary image cache
+void compareLoading(const std::string& fileName, int repeats)
+{
+    IntcodeImage::load(fileName);   // Fills the cache
+    auto begin = std::chrono::steady_clock::now();
+    size_t cells = 0;
+    for (int i = 0; i < repeats; i++) {
+        cells += IntcodeComputer(std::fstream(fileName)).getMemory(0) != 0;
+    }
+    auto parsed = std::chrono::steady_clock::now();
+    bool cached = true;
+    for (int i = 0; i < repeats; i++)
+    {
+        IntcodeImage image = IntcodeImage::load(fileName);
+        cached = cached && image.fromCache();
+        cells += IntcodeComputer(image).getMemory(0) != 0;
+    }
+    auto end = std::chrono::steady_clock::now();
+    double text = std::chrono::duration<double, std::micro>(parsed - begin).count() / repeats,
+        image = std::chrono::duration<double, std::micro>(end - parsed).count() / repeats;
+    std::printf("loading %s: text %.1f us, image cache %.1f us  x%.2f%s\n", fileName.c_str(), text, image, text / image,
+        cached ? "" : "  (cache not used)");
+}
+
+// Follows a random cycle through an array of cells for steps steps and
+// outputs the cell it ended on. Each cell holds the distance to the next one
+// and the relative base walks the cycle, so every step reads one cell in a
+// random place.
+std::vector<long long> pointerChase(long long cells, long long steps)
+{
+    std::vector<long long> intCode {
+        109, 15,                // rb = array
+        209, 0,                 // loop: rb += [rb]
+        1001, 14, -1, 14,       // steps--
+        1005, 14, 2,            // while steps
+        204, 0,
+        99,
+        steps
+    };
+    std::vector<long long> next(cells);
+    for (long long i = 0; i < cells; i++) next[i] = i;
+    unsigned long long x = 1;
+    for (long long i = cells - 1; i > 0; i--)
+    {
+        // Sattolo's shuffle, a single cycle over all cells
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        std::swap(next[i], next[(x >> 33) % i]);
+    }
+    for (long long i = 0; i < cells; i++) intCode.push_back(next[i] - i);
+    return intCode;
+}
+
+template <typename Cell>
+BenchResult runCells(const std::vector<long long>& intCode, int repeats)
+{
+    BasicIntcodeComputer<Cell> ic(intCode);
+    ic.setVerbosity(false);
+    ic.setBackend(Backend::THREADED);
+
+    BenchResult result;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++)
+    {
+        ic.reset();
+        ic.run();
+        result.lastOutput = ic.popOutput();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    result.instructions = ic.getInstructionCount();
+    result.pages = ic.getPagesTouched();
+    return result;
+}
+
+// The same random walk over arrays of growing size with 32, 64 and 128 bit
+// cells. Once the array outgrows a cache level the narrower cells keep twice
+// as many of them in it.
+void compareCellTypes(long long steps)
+{
+    std::printf("cell types, threaded backend, %lld random reads\n", steps);
+    for (long long cells : {1LL << 12, 1LL << 15, 1LL << 18, 1LL << 21, 1LL << 23})
+    {
+        const std::vector<long long> intCode = pointerChase(cells, steps);
+        BenchResult narrow = runCells<int32_t>(intCode, 1), wide = runCells<long long>(intCode, 1),
+            widest = runCells<__int128>(intCode, 1);
+        std::printf("  %9lld cells  int32 %7.1f Minstr/s  int64 %7.1f Minstr/s  int128 %7.1f Minstr/s  int32/int64 x%.2f%s\n",
+            cells, narrow.instructions / narrow.seconds / 1e6, wide.instructions / wide.seconds / 1e6,
+            widest.instructions / widest.seconds / 1e6, wide.seconds / narrow.seconds,
+            narrow.lastOutput == wide.lastOutput && wide.lastOutput == widest.lastOutput ? "" : "  (outputs differ)");
+    }
+}
+
+// Every noun/verb pair of day02, LANES at a time in lockstep and one by one
+// on the reference backend. The vector path needs the bench built with -mavx2.
+template <int LANES>
+bool compareBatch(const std::vector<long long>& intCode)
+{
+    const int pairs = 100 * 100;
+    std::vector<long long> batched(pairs), single(pairs);
+
+    auto begin = std::chrono::steady_clock::now();
+    IntcodeBatch<LANES> batch(intCode);
+    for (int first = 0; first < pairs; first += LANES)
+    {
+        batch.reset();
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            batch.set(lane, 1, (first + lane) / 100);
+            batch.set(lane, 2, (first + lane) % 100);
+        }
+        batch.run();
+        for (int lane = 0; lane < LANES; lane++) {
+            batched[first + lane] = batch.isFaulted(lane) ? -1 : batch.get(lane, 0);
+        }
+    }
+    const double batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    begin = std::chrono::steady_clock::now();
+    IntcodeComputer ic(intCode);
+    ic.setVerbosity(false);
+    ic.setBackend(Backend::REFERENCE);
+    for (int pair = 0; pair < pairs; pair++)
+    {
+        ic.reset();
+        ic.setMemory(1, pair / 100);
+        ic.setMemory(2, pair % 100);
+        try
+        {
+            ic.run();
+            single[pair] = ic.getMemory(0);
+        }
+        catch (const std::exception&) {
+            single[pair] = -1;
+        }
+    }
+    const double singleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+#if defined(__AVX2__)
+    const char* path = "AVX2";
+#else
+    const char* path = "scalar";
+#endif
+    // Stats add up over resets
+    const typename IntcodeBatch<LANES>::Stats stats = batch.getStats();
+    const bool same = batched == single;
+    std::printf("day02 pairs, %d lanes (%s)  %.3f ms, reference %.3f ms  x%.2f  utilization %.1f%%, %llu of %llu steps divergent  %s\n",
+        LANES, path, 1000 * batchSeconds, 1000 * singleSeconds, singleSeconds / batchSeconds, 100 * stats.utilization(),
+        stats.divergentSteps, stats.steps, same ? "match" : "DIFFER");
+    return same;
+}
+
+// Noun and verb of day02 part 2 from a sweep over every pair, on one thread
+// and on several, against the solution of position 0 in closed form
+bool compareSweep(const std::vector<long long>& intCode, size_t threads)
+{
+    const long long target = 19690720;
+    long long expected = -1;
+    IntcodeSymbolic symbolic(intCode, {1, 2});
+    if (symbolic.run() && symbolic.isResolved(0))
+    {
+        auto solution = IntcodeSymbolic::solve(symbolic.value(0), target, { {1, 0, 99}, {2, 0, 99} });
+        if (solution) expected = 100 * solution->at(1) + solution->at(2);
+    }
+
+    std::vector<IntcodeSweep::Patch> jobs;
+    for (int noun = 0; noun < 100; noun++)
+    for (int verb = 0; verb < 100; verb++)
+        jobs.push_back(IntcodeSweep::Patch { {1, noun}, {2, verb} });
+
+    bool same = expected >= 0;
+    for (size_t count : {(size_t) 1, threads})
+    {
+        IntcodeSweep sweep(intCode, count);
+        IntcodeSweep::Result result = sweep.find(jobs, [](IntcodeComputer& ic) { return ic.getMemory(0) == target; });
+        const long long found = result.found() ? (long long) result.job : -1;
+        same &= found == expected;
+        std::printf("day02 sweep, %zu threads  %llu of %zu jobs %8.3f ms  found %lld, closed form %lld  %s\n",
+            count, result.jobsRun, jobs.size(), 1000 * result.seconds, found, expected, found == expected ? "match" : "DIFFER");
+    }
+    return same;
+}
+
+// Every feedback phase setting of day07 as one fleet of 600 VMs, on a single
+// worker and on several. Parking, waking and stealing race across workers
+// there, the thrusts have to come out the same.
+bool compareScheduler(const std::vector<long long>& intCode, size_t workers, int rounds)
+{
+    std::vector<long long> expected;
+    bool same = true;
+    for (size_t count : {(size_t) 1, workers})
+    {
+        IntcodeScheduler scheduler(count);
+        IntcodeComputer amp(intCode);
+        amp.setVerbosity(false);
+        std::vector< std::array<int, 5> > phases;
+        std::array<int, 5> perm = {5, 6, 7, 8, 9};
+        do {
+            const size_t first = scheduler.size();
+            for (int i = 0; i < 5; i++) scheduler.add(amp);
+            for (int i = 0; i < 5; i++) scheduler.connect(first + i, first + (i + 1) % 5);
+            phases.push_back(perm);
+        } while (std::next_permutation(perm.begin(), perm.end()));
+
+        IntcodeScheduler::Stats total;
+        unsigned long long steals = 0;
+        for (int round = 0; round < rounds; round++)
+        {
+            scheduler.reset();
+            for (size_t fleet = 0; fleet < phases.size(); fleet++)
+            {
+                for (int i = 0; i < 5; i++) scheduler.send(5 * fleet + i, phases[fleet][i]);
+                scheduler.send(5 * fleet, 0);
+            }
+            IntcodeScheduler::Stats stats = scheduler.run();
+            total.seconds += stats.seconds;
+            total.instructions += stats.instructions;
+            for (auto& worker : stats.workers) steals += worker.steals;
+
+            std::vector<long long> thrusts;
+            for (size_t fleet = 0; fleet < phases.size(); fleet++)
+            {
+                std::vector<long long> thrust = scheduler.receive(5 * fleet + 4);
+                thrusts.push_back(thrust.empty() ? -1 : thrust.back());
+            }
+            if (expected.empty()) expected = thrusts;
+            same &= thrusts == expected;
+        }
+        std::printf("day07 fleets, %zu VMs on %zu workers (%d runs)  %.3f s %10.2f Minstr/s  %llu steals  %s\n",
+            scheduler.size(), count, rounds, total.seconds, total.instructionsPerSecond() / 1e6, steals,
+            same ? "match" : "DIFFER");
+    }
+    return same;
+}
+
+#if defined(INTCODE_PROFILE)
+// Profile of one run, as CSV and as folded stacks for flamegraph.pl
+void profileProgram(const std::string& name, const std::vector<long long>& intCode)
+{
+    IntcodeComputer ic(intCode);
+    ic.setVerbosity(false);
+    ic.setBackend(Backend::PREDECODED);
+    ic.setProfiling(true);
+    while (ic.run() == IntcodeComputer::StopReason::NEED_INPUT) ic.pushInput(0);
+
+    std::ofstream csv(name + ".profile.csv"), folded(name + ".folded");
+    ic.getProfile().writeCsv(csv);
+    ic.getProfile().writeFolded(folded, name);
+    std::printf("Profile of %s written to %s.profile.csv and %s.folded\n", name.c_str(), name.c_str(), name.c_str());
+}
+#endif
+
+#if defined(INTCODE_TRACE)
+// Records repeats runs of the program and compares the time with untraced
+// runs. The state the trace gives back at several steps of the first and the
+// last run, the latter found through a checkpoint, is checked against a live
+// VM stopped at the same step of a single run.
+bool traceProgram(const std::string& name, const std::vector<long long>& intCode, int repeats)
+{
+    const std::string fileName = name + ".trace";
+    const BenchResult plain = runProgram(intCode, Backend::PREDECODED, repeats, nullptr);
+
+    IntcodeComputer ic(intCode);
+    ic.setVerbosity(false);
+    ic.setBackend(Backend::PREDECODED);
+    IntcodeTraceRecorder::Stats stats;
+    auto begin = std::chrono::steady_clock::now();
+    {
+        IntcodeTraceRecorder recorder(fileName);
+        ic.setTraceRecorder(&recorder);
+        for (int i = 0; i < repeats; i++)
+        {
+            ic.reset();
+            while (ic.run() == IntcodeComputer::StopReason::NEED_INPUT) ic.pushInput(0);
+            while (ic.hasOutput()) ic.popOutput();
+        }
+        ic.setTraceRecorder(nullptr);
+        stats = recorder.close();
+    }
+    const double traced = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    IntcodeTraceReader reader(fileName);
+    const unsigned long long runSteps = reader.steps() / repeats;
+    bool same = true;
+    const unsigned long long lastRun = reader.steps() - runSteps;
+    for (unsigned long long traceStep : {0ULL, 1ULL, runSteps / 3, runSteps - 1, lastRun, lastRun + runSteps / 2})
+    {
+        const IntcodeTraceReader::State state = reader.stateAt(traceStep);
+        const unsigned long long step = traceStep % runSteps;
+
+        IntcodeComputer live(intCode);
+        live.setVerbosity(false);
+        live.setBackend(Backend::REFERENCE);
+        while (live.getInstructionCount() < step &&
+            live.run(step - live.getInstructionCount()) == IntcodeComputer::StopReason::NEED_INPUT) {
+            live.pushInput(0);
+        }
+        const IntcodeComputer::Snapshot snapshot = live.snapshot();
+        bool match = live.getInstructionCount() == step && snapshot.instructionPointer == state.instructionPointer &&
+            snapshot.relativeBase == state.relativeBase;
+        for (auto& cell : state.memory.changed()) {
+            match &= live.getMemory(cell.first) == cell.second;
+        }
+        for (long long address = 0; address < (long long) intCode.size(); address++) {
+            match &= live.getMemory(address) == state.memory.get(address);
+        }
+        if (!match) std::printf("  state at step %llu differs from the live run\n", traceStep);
+        same &= match;
+    }
+    std::remove(fileName.c_str());
+
+    std::printf("%s traced (%d runs)  %.3f s -> %.3f s  x%.2f  %.2f bytes per step, %llu checkpoints  replay %s\n",
+        name.c_str(), repeats, plain.seconds, traced, traced / plain.seconds, (double) stats.bytes / stats.steps,
+        stats.checkpoints, same ? "match" : "DIFFER");
+    return same;
+}
+#endif
+
+int main ()
+{
+#if defined(INTCODE_PROFILE)
+    profileProgram("day09", loadProgram("day09.txt"));
+    profileProgram("intcode_bench_loop", loadProgram("intcode_bench_loop.txt"));
+#endif
+#if defined(INTCODE_TRACE)
+    if (!traceProgram("day09", loadProgram("day09.txt"), 2000)) {
+        std::printf("Trace replay differs from the live run\n");
+    }
+#endif
+    if (!checkRegressions()) std::printf("Regression programs fail\n");
+    compareBackends("day09", loadProgram("day09.txt"), 20000);
+    compareTextLoaders(4000000);
+    compareLoading("day13.txt", 1000);
+    compareCellTypes(20000000);
+
+    const std::vector<Workload> programs = workloads();
+    bool same = compareWorkloads(programs);
+    for (auto& workload : programs) {
+        same &= compareOptimizer(workload.name, workload.intCode, workload.repeats, workload.policy, workload.maxInputs);
+    }
+    if (!same) std::printf("Runs differ between backends or with the optimizer\n");
+
+    const std::vector<long long> day02 = loadProgram("day02.txt");
+    if (!compareBatch<4>(day02) || !compareBatch<8>(day02)) {
+        std::printf("Lockstep runs differ from the reference\n");
+    }
+    if (!compareSweep(day02, std::max(4u, std::thread::hardware_concurrency()))) {
+        std::printf("Sweep differs from the closed form\n");
+    }
+    if (!compareScheduler(loadProgram("day07.txt"), std::max(4u, std::thread::hardware_concurrency()), 200)) {
+        std::printf("Scheduled fleets differ between worker counts\n");
+    }
+#if defined(HAVE_BENCH_LOOP_NATIVE)
+    compareBackends("counting loop", loadProgram("intcode_bench_loop.txt"), 1, &intcode_bench_loop_native);
+#else
+    compareBackends("counting loop", loadProgram("intcode_bench_loop.txt"), 1);
+#endif
+}
@@ -8,182 +8,1382 @@
 #include "my_macros.hpp"
 #include <fstream>
 #include <sstream>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <memory>
+#include <type_traits>
+#include <cstdlib>
+#include "intcode_instruction_set.hpp"
+#include "intcode_memory.hpp"
+#include "intcode_ring_buffer.hpp"
+#include "intcode_jit.hpp"
+#include "intcode_native_program.hpp"
+#include "intcode_optimizer.hpp"
+#include "intcode_image.hpp"
+#include "intcode_loader.hpp"
 
-class IntcodeComputer
+// Profiling hooks, they compile to nothing unless INTCODE_PROFILE is defined
+#if defined(INTCODE_PROFILE)
+#include "intcode_profile.hpp"
+#define INTCODE_PROFILE_INSTRUCTION(address, word) if (_profiling) _profile.instruction(address, word);
+#define INTCODE_PROFILE_JUMP(address, taken) if (_profiling) _profile.jump(address, taken);
+#define INTCODE_PROFILE_RETRACT(address) if (_profiling) _profile.retract(address);
+#else
+#define INTCODE_PROFILE_INSTRUCTION(address, word)
+#define INTCODE_PROFILE_JUMP(address, taken)
+#define INTCODE_PROFILE_RETRACT(address)
+#endif
+
+// Trace hooks, compiled in with INTCODE_TRACE
+#if defined(INTCODE_TRACE)
+#include "intcode_trace.hpp"
+#define INTCODE_TRACE_EVENT(call) if (_trace != nullptr) _trace->call;
+#else
+#define INTCODE_TRACE_EVENT(call)
+#endif
+
+// Backends and stop reasons, the same for every cell type
+struct IntcodeExecution
 {
 
-enum Opcode 
+enum class Backend
 {
-    HALT            = 99,
-    ADD             = 1,
-    MULT            = 2,
-    INPUT           = 3,
-    OUTPUT          = 4,
-    JUMP_IF_TRUE    = 5,
-    JUMP_IF_FALSE   = 6,
-    LESS_THAN       = 7,
-    EQUALS          = 8,
-    BASE_OP         = 9
+    REFERENCE,      // Original loop decoding the raw word on every step
+    PREDECODED,     // Switch loop running off the decoded instruction cache
+    THREADED,       // Computed goto dispatch over the decoded instruction cache
+    JIT,            // Native x86-64 blocks, predecoded interpreter for everything else
+    NATIVE          // Program translated ahead of time by intcode_translate
 };
 
-enum ParameterMode 
+// Why run() or step() returned
+enum class StopReason
 {
-    POSITION_MODE   = 0,
-    IMMEDIATE_MODE  = 1,
-    RELATIVE_MODE   = 2
+    NEED_INPUT,         // INPUT with the input queue empty, it runs once input is pushed
+    OUTPUT,             // step() executed an OUTPUT
+    HALTED,
+    BUDGET_EXHAUSTED    // Instruction budget used up, calling again continues
 };
 
-public:
+    static constexpr unsigned long long NO_BUDGET = ~0ULL;
+
+    static const char* backendName(Backend backend)
+    {
+        switch (backend)
+        {
+            case Backend::PREDECODED:
+                return "predecoded";
+
+            case Backend::THREADED:
+                return "threaded";
 
-    explicit IntcodeComputer(std::fstream&& intCodeFileStream) :
-        IntcodeComputer([&intCodeFileStream]() 
+            case Backend::JIT:
+                return "jit";
+
+            case Backend::NATIVE:
+                return "native";
+
+            default:
+                return "reference";
+        };
+    }
+
+    static Backend parseBackend(const std::string& name)
+    {
+        for (Backend backend : {Backend::REFERENCE, Backend::PREDECODED, Backend::THREADED, Backend::JIT, Backend::NATIVE})
         {
-            std::vector<long long> intCode;
-            std::string line, token;
-            getline(intCodeFileStream, line);
-            std::stringstream ss(line);
-            while (getline(ss, token, ',')) intCode.push_back(std::stoll(token));
-            return intCode;
-        }())
+            if (name == backendName(backend)) {
+                return backend;
+            }
+        }
+        throw std::runtime_error("Unknown Intcode backend " + name +
+            ", expected reference, predecoded, threaded, jit or native");
+    }
+
+    // Backend a new computer starts with: $INTCODE_BACKEND, or fallback if it
+    // is not set. The native backend needs a translated program, so it can
+    // only be chosen through setBackend().
+    static Backend defaultBackend(Backend fallback = Backend::REFERENCE)
+    {
+        static const char* const name = std::getenv("INTCODE_BACKEND");
+        if (name == nullptr || *name == 0) {
+            return fallback;
+        }
+        static const Backend chosen = parseBackend(name);
+        if (chosen == Backend::NATIVE) {
+            throw std::runtime_error("INTCODE_BACKEND=native needs a program from intcode_translate, see setNativeProgram");
+        }
+        return chosen;
+    }
+};
+
+// Cell is the type of the memory cells and of every value the program
+// computes. Addresses (instruction pointer, relative base, memory indices)
+// are long long whatever the cell type. Cells narrower than 64 bits throw
+// std::overflow_error on an arithmetic result they cannot hold, a 128 bit
+// cell throws std::out_of_range when used as an address beyond 64 bits.
+// The JIT and native backends run on 64 bit cells only, the others
+// interpret for any other cell type.
+template <typename Cell = long long>
+class BasicIntcodeComputer : public IntcodeExecution, private IntcodeInstructionSet
+{
+    typedef BasicDecodedInstruction<Cell> DecodedInstruction;
+    typedef BasicIntcodeMemory<Cell> Memory;
+
+    // Compiled and translated code works on 64 bit cells
+    static constexpr bool COMPILED_CELLS = std::is_same<Cell, long long>::value;
+
+public:
+
+    explicit BasicIntcodeComputer(std::fstream&& intCodeFileStream) :
+        BasicIntcodeComputer(IntcodeLoader::load(intCodeFileStream))
+    { }
+
+    // Binary image, see IntcodeImage::load for text programs through the image cache
+    explicit BasicIntcodeComputer(const IntcodeImage& image) :
+        BasicIntcodeComputer(image.toVector())
     { }
 
-    explicit IntcodeComputer(std::vector<long long> intCode)
-        :_intCode(intCode), _intCodeOrig(intCode) 
+    // Throws std::out_of_range if a cell of the image does not fit the cell type
+    explicit BasicIntcodeComputer(std::vector<long long> intCode)
+        :_intCode(toCells(intCode)), _intCodeOrig(intCode)
     {
-        _operationsMap.emplace(ADD, [](long long a, long long b) { return a+b; } );
-        _operationsMap.emplace(MULT, [](long long a, long long b) { return a*b; } );
-        _operationsMap.emplace(LESS_THAN, [](long long a, long long b) { return a < b ? 1 : 0; } );
-        _operationsMap.emplace(EQUALS, [](long long a, long long b) { return a == b ? 1 : 0; } );
+        _operationsMap.emplace(ADD, [](Cell a, Cell b) { return add(a, b); } );
+        _operationsMap.emplace(MULT, [](Cell a, Cell b) { return multiply(a, b); } );
+        _operationsMap.emplace(LESS_THAN, [](Cell a, Cell b) { return a < b ? 1 : 0; } );
+        _operationsMap.emplace(EQUALS, [](Cell a, Cell b) { return a == b ? 1 : 0; } );
     }
     
     void reset()
     {
-    int i = 0;
-        _intCode = std::vector<long long> (_intCodeOrig);
+        _intCode.reset();
         _instructionPointer = 0;
         _halted = false;
-        _lastOutput = -1;
         _relativeBase = 0;
+        _input.clear();
+        _output.clear();
+        // Entries decoded without the optimizer are not wanted once it is back on
+        if (_optimizer != nullptr && !_optimizedValid) {
+            clearDecoded();
+        }
+        dropChangedDecoded();
+        std::fill(_nativeStale.begin(), _nativeStale.end(), 0);
+        _optimizedValid = _optimizer != nullptr;
+#if defined(INTCODE_JIT_AVAILABLE)
+        if constexpr (COMPILED_CELLS) {
+            _jit.revalidate(_intCode.dense(), _intCode.denseSize());
+        }
+#endif
+        INTCODE_TRACE_EVENT(reset(_instructionPointer, _relativeBase));
+    }
+
+    // VM state at one point, memory pages are shared between snapshots.
+    // Pending inputs and unread outputs are part of it.
+    struct Snapshot
+    {
+        typename Memory::Snapshot memory;
+        IntcodeRingBuffer<Cell> input, output;
+        long long instructionPointer;
+        long long relativeBase;
+        bool halted;
+        std::vector<unsigned char> nativeStale;
+    };
+
+    Snapshot snapshot()
+    {
+        return Snapshot {_intCode.snapshot(), _input, _output, _instructionPointer, _relativeBase, _halted, _nativeStale};
+    }
+
+    // Cells that differ from the snapshot go through the write barrier, so the
+    // decoded and compiled code stays valid
+    void restore(const Snapshot& snapshot)
+    {
+        _intCode.restore(snapshot.memory, [this](long long index)
+        {
+            if (isCode(index)) {
+                codeWritten(index);
+            }
+        });
+        _input = snapshot.input;
+        _output = snapshot.output;
+        _instructionPointer = snapshot.instructionPointer;
+        _relativeBase = snapshot.relativeBase;
+        _halted = snapshot.halted;
+        _nativeStale = snapshot.nativeStale;
+#if defined(INTCODE_TRACE)
+        traceState();
+#endif
+    }
+
+    // Independent copy of the VM in its current state, compiled code is not copied
+    BasicIntcodeComputer fork()
+    {
+        BasicIntcodeComputer copy = *this;
+#if defined(INTCODE_TRACE)
+        copy._trace = nullptr;
+#endif
+        return copy;
     }
 
     void setVerbosity(bool value) { _verbose = value; }
-    int calculate()
+    void setBackend(Backend backend)
+    {
+        _backend = backend;
+        clearDecoded();
+    }
+
+    // Fuses common instruction pairs into single handlers in the predecoded and threaded loops
+    void setFusion(bool value)
+    {
+        _fusion = value;
+        clearDecoded();
+    }
+
+    struct FusionStats
+    {
+        unsigned long long compareJump = 0;     // LESS_THAN/EQUALS + JUMP_IF_TRUE/JUMP_IF_FALSE executions
+        unsigned long long addCompare = 0;      // ADD + LESS_THAN/EQUALS executions
+        unsigned long long broken = 0;          // Pairs cut short because the first write changed their cells
+    };
+
+    FusionStats getFusionStats() { return _fusionStats; }
+
+    struct InvalidationStats
+    {
+        unsigned long long codeWrites = 0;      // Writes landing on a cell marked in the code bitmap
+        unsigned long long decodedEntries = 0;  // Decoded (or fused) instructions dropped
+        unsigned long long jitBlocks = 0;       // Compiled blocks dropped
+        unsigned long long nativeDisabled = 0;  // Translated blocks switched off
+        unsigned long long deoptimized = 0;     // Times the optimized instructions were dropped
+    };
+
+    InvalidationStats getInvalidationStats() { return _invalidationStats; }
+
+    // Program produced by intcode_translate from the same image, used by Backend::NATIVE
+    void setNativeProgram(const IntcodeNative::Program& program)
     {
-        return calculate_internal(-1, _intCode, false, true);
+        if (!COMPILED_CELLS) {
+            throw std::logic_error("Native programs run on 64 bit cells");
+        }
+        if (program.imageSize != (long long) _intCodeOrig.size() ||
+            !std::equal(_intCodeOrig.begin(), _intCodeOrig.end(), program.image)) {
+            throw std::runtime_error(std::string("Native program ") + program.name +
+                " was translated from a different image");
+        }
+        _native = &program;
+        _nativeStale.assign(program.blockCount, 0);
+        for (long long i = 0; i < program.imageSize; i++)
+        {
+            if (program.codeMask[i]) {
+                markCode(i, i + 1);
+            }
+        }
     }
 
-    int calculateSingle()
+    // Decoded instructions from IntcodeOptimizer's load-time pass over the image
+    // for the interpreting backends, until a cell the pass relied on is written
+    void setOptimizer(bool value)
     {
-        return calculate_internal(-1, _intCode, true, true);
+        _optimizer.reset(value ? new IntcodeOptimizer(_intCodeOrig) : nullptr);
+        _optimizedValid = value;
+        clearDecoded();
+        if (!value) {
+            return;
+        }
+        for (long long cell : _optimizer->watchedCells())
+        {
+            markCode(cell, cell + 1);
+            if (_intCode.get(cell) != _intCodeOrig[cell]) {
+                _optimizedValid = false;
+            }
+        }
     }
 
-    int calculateSingle(int input)
+    IntcodeOptimizer::Stats getOptimizerStats() { return _optimizer ? _optimizer->stats() : IntcodeOptimizer::Stats(); }
+
+    Backend getBackend() { return _backend; }
+    unsigned long long getInstructionCount() { return _instructionCount; }
+
+    // Memory pages holding cells since the last reset
+    size_t getPagesTouched() { return _intCode.pagesTouched(); }
+
+#if defined(INTCODE_PROFILE)
+    // Counts every instruction executed from here on. Compiled code cannot be
+    // counted, the JIT and native backends interpret while profiling.
+    void setProfiling(bool value)
     {
-        return calculate_internal(input, _intCode, true, false);
+        _profiling = value;
+        clearDecoded();   // Optimized instructions are not counted as the words they were loaded from
     }
+    IntcodeProfile& getProfile() { return _profile; }
+#endif
 
-    std::pair<int, int> calcDoubleOutput(int input)
+#if defined(INTCODE_TRACE)
+    // Records everything the VM does from here on, starting with its current
+    // state. Like profiling, it keeps the JIT and native backends interpreting.
+    void setTraceRecorder(IntcodeTraceRecorder* recorder)
     {
-        int first = calculate_internal(input, _intCode, true, false);
-        int second = calculate_internal(input, _intCode, true, false);
-        return std::make_pair(first, second);
+        static_assert(sizeof(Cell) <= sizeof(long long), "Traces record 64 bit cells");
+        _trace = recorder;
+        if (_trace != nullptr)
+        {
+            _trace->start(_intCodeOrig);
+            traceState();
+        }
     }
+#endif
 
-    int getLastOutput() { return _lastOutput; }
+    // Memory access from outside of the program, writes go through the write
+    // barrier. Values written or pushed as input are range checked against the cell type.
+    Cell getMemory(long long address) { return getMemoryVal(address); }
+
+    template <typename Value>
+    void setMemory(long long address, Value value) { setMemoryVal(address, toCell(value)); }
+
+    // Runs in place until the program halts, reaches an INPUT with the input
+    // queue empty or has executed budget instructions. Every output is appended
+    // to the output queue. Compiled blocks and fused pairs are not split, so the
+    // budget can be overrun by a few instructions.
+    StopReason run(unsigned long long budget = NO_BUDGET)
+    {
+        return execute(budget, false);
+    }
+
+    // Same as run(), but also stops right after the next OUTPUT
+    StopReason step(unsigned long long budget = NO_BUDGET)
+    {
+        return execute(budget, true);
+    }
+
+    template <typename Value>
+    void pushInput(Value value) { _input.push(toCell(value)); }
+
+    template <typename Container>
+    void pushInputs(const Container& values)
+    {
+        for (const auto& value : values) _input.push(toCell(value));
+    }
+
+    bool hasOutput() { return !_output.empty(); }
+    size_t outputSize() { return _output.size(); }
+    Cell popOutput() { return _output.pop(); }
 
     bool isHalted() { return _halted; }
     
 private:
 
-    void setMemoryVal(long long index, long long value)
+#if defined(INTCODE_TRACE)
+    // Whole state as a reset followed by the cells that differ from the image
+    void traceState()
+    {
+        if (_trace == nullptr) {
+            return;
+        }
+        _trace->reset(_instructionPointer, _relativeBase);
+        _intCode.forEachChanged([this](long long address, Cell value) { _trace->write(address, value); });
+    }
+#endif
+
+    // Value converted to the cell type, throws if it does not fit
+    template <typename Value>
+    static Cell toCell(Value value)
+    {
+        const Cell cell = static_cast<Cell>(value);
+        if (static_cast<Value>(cell) != value || (cell < 0) != (value < 0)) {
+            throw std::out_of_range("Value " + valueString(value) + " does not fit the Intcode cell type");
+        }
+        return cell;
+    }
+
+    static std::vector<Cell> toCells(const std::vector<long long>& image)
+    {
+        if constexpr (std::is_same<Cell, long long>::value) {
+            return image;
+        }
+        else
+        {
+            std::vector<Cell> cells(image.size());
+            for (size_t i = 0; i < image.size(); i++) {
+                cells[i] = toCell(image[i]);
+            }
+            return cells;
+        }
+    }
+
+    // Cell (or an address computed in the cell type) used as an address
+    template <typename Value>
+    static long long toAddress(Value value)
     {
-        while (index > _intCode.size() - 1) {
-            _intCode.push_back(0);
+        if constexpr (sizeof(Value) > sizeof(long long))
+        {
+            if (value != static_cast<long long>(value)) {
+                throw std::out_of_range("Intcode address " + valueString(value) + " is beyond 64 bits");
+            }
         }
-        _intCode[index] = value;
+        return static_cast<long long>(value);
     }
 
-    long long getMemoryVal(long long index)
+    // 64 bit cells wrap as in the compiled backends, narrower cells refuse a
+    // result they cannot hold
+    static Cell add(Cell a, Cell b)
     {
-        while (index > _intCode.size() - 1) {
-            _intCode.push_back(0);
+        if constexpr (sizeof(Cell) < sizeof(long long))
+        {
+            Cell result;
+            if (__builtin_add_overflow(a, b, &result)) {
+                throw std::overflow_error(valueString(a) + " + " + valueString(b) + " overflows the Intcode cell type");
+            }
+            return result;
+        }
+        else {
+            return a + b;
         }
-        return _intCode[index];
     }
 
-    int getArgIndex(int paramMode, int index)
+    static Cell multiply(Cell a, Cell b)
+    {
+        if constexpr (sizeof(Cell) < sizeof(long long))
+        {
+            Cell result;
+            if (__builtin_mul_overflow(a, b, &result)) {
+                throw std::overflow_error(valueString(a) + " * " + valueString(b) + " overflows the Intcode cell type");
+            }
+            return result;
+        }
+        else {
+            return a * b;
+        }
+    }
+
+    // std::to_string and the streams have no 128 bit overloads
+    template <typename Value>
+    static std::string valueString(Value value)
+    {
+        if constexpr (sizeof(Value) <= sizeof(long long)) {
+            return std::to_string(value);
+        }
+        else
+        {
+            std::string digits;
+            Value rest = value;
+            do
+            {
+                const int digit = (int) (rest % 10);
+                digits.insert(digits.begin(), (char) ('0' + (digit < 0 ? -digit : digit)));
+                rest /= 10;
+            } while (rest != 0);
+            return value < 0 ? "-" + digits : digits;
+        }
+    }
+
+    void setMemoryVal(long long index, Cell value)
+    {
+        INTCODE_TRACE_EVENT(write(index, value));
+        _intCode.set(index, value);
+        if (isCode(index)) {
+            codeWritten(index);
+        }
+    }
+
+    // Code bitmap: one bit per cell any backend decoded, compiled or translated
+    // an instruction from. Bits are only ever set, so the map stays a (conservative)
+    // superset of the cached code across resets.
+    bool isCode(long long index)
+    {
+        return (unsigned long long) (index >> 6) < _codeBits.size() && ((_codeBits[index >> 6] >> (index & 63)) & 1);
+    }
+
+    void markCode(long long first, long long last)
+    {
+        reserveCodeBits(last);
+        for (long long i = first; i < last; i++) {
+            _codeBits[i >> 6] |= 1ULL << (i & 63);
+        }
+    }
+
+    // Compiled and translated code tests the bitmap for every address inside of memory
+    const unsigned long long* reserveCodeBits(long long cells)
+    {
+        if ((long long) _codeBits.size() * 64 < cells) {
+            _codeBits.resize((cells + 63) / 64, 0);
+        }
+        return _codeBits.data();
+    }
+
+    // Write barrier, drops whatever was cached from the cell
+    void codeWritten(long long index)
+    {
+        _invalidationStats.codeWrites++;
+        markHot(index);
+        if (_optimizedValid && _optimizer->watches(index)) {
+            deoptimize();
+        }
+        _invalidationStats.decodedEntries += invalidateDecoded(index);
+        if (_native != nullptr && index < _native->imageSize && _native->blockOf[index] >= 0 &&
+            !_nativeStale[_native->blockOf[index]] && _intCode.get(index) != _native->image[index])
+        {
+            _nativeStale[_native->blockOf[index]] = 1;
+            _invalidationStats.nativeDisabled++;
+        }
+#if defined(INTCODE_JIT_AVAILABLE)
+        if (_jit.covers(index)) {
+            _invalidationStats.jitBlocks += _jit.invalidate(index);
+        }
+#endif
+    }
+
+    Cell getMemoryVal(long long index)
+    {
+        return _intCode.get(index);
+    }
+
+    long long getArgIndex(int paramMode, long long index)
     {
         switch (paramMode)
         {    
             case POSITION_MODE:
-                return getMemoryVal(index);                
+                return toAddress(getMemoryVal(index));
 
             case IMMEDIATE_MODE:
                 return index;
 
             case RELATIVE_MODE:
-                return _relativeBase + getMemoryVal(index);
+                return toAddress(_relativeBase + getMemoryVal(index));
             
             default:
                 return -1;
         }; 
     }
 
-    int calculate_internal(int input, std::vector<long long> intCode, bool returnOnOutput = false, bool takeUserInput = false)
+    StopReason execute(unsigned long long budget, bool stopOnOutput)
+    {
+        if (_halted) {
+            return StopReason::HALTED;
+        }
+        _instructionLimit = budget > NO_BUDGET - _instructionCount ? NO_BUDGET : _instructionCount + budget;
+
+#if defined(INTCODE_TRACE)
+        if (_trace != nullptr)
+        {
+            const StopReason reason = _backend == Backend::JIT || _backend == Backend::NATIVE ?
+                calculate_predecoded(stopOnOutput) : dispatch(stopOnOutput);
+            _trace->stop(_instructionPointer, _relativeBase);
+            return reason;
+        }
+#endif
+#if defined(INTCODE_PROFILE)
+        if (_profiling && (_backend == Backend::JIT || _backend == Backend::NATIVE)) {
+            return calculate_predecoded(stopOnOutput);
+        }
+#endif
+        return dispatch(stopOnOutput);
+    }
+
+    StopReason dispatch(bool stopOnOutput)
+    {
+        switch (_backend)
+        {
+            case Backend::PREDECODED:
+                return calculate_predecoded(stopOnOutput);
+
+            case Backend::THREADED:
+                return calculate_threaded(stopOnOutput);
+
+            case Backend::JIT:
+                if constexpr (COMPILED_CELLS) {
+                    return calculate_jit(stopOnOutput);
+                }
+                else {
+                    return calculate_predecoded(stopOnOutput);
+                }
+
+            case Backend::NATIVE:
+                if constexpr (COMPILED_CELLS) {
+                    return calculate_native(stopOnOutput);
+                }
+                else {
+                    return calculate_predecoded(stopOnOutput);
+                }
+
+            default:
+                return calculate_reference(stopOnOutput);
+        };
+    }
+
+    bool budgetExhausted() { return _instructionCount >= _instructionLimit; }
+
+    // Running past the last cell ends the program like a HALT
+    StopReason endOfMemory()
+    {
+        _halted = true;
+        LOG_COND(_verbose, "Computer ran past the end of memory\n");
+        return StopReason::HALTED;
+    }
+
+    // Entries stay in place, a handler in the middle of a write checks its opCode afterwards
+    void deoptimize()
+    {
+        _optimizedValid = false;
+        _invalidationStats.deoptimized++;
+        _invalidationStats.decodedEntries += _decoded.size();
+        std::fill(_decoded.begin(), _decoded.end(), DecodedInstruction());
+    }
+
+    // Any instruction covering the written cell starts at most 3 cells before it,
+    // a fused pair covering it at most MAX_FUSED_LENGTH - 1 cells before it
+    int invalidateDecoded(long long index)
+    {
+        long long first = std::max(0LL, index - MAX_FUSED_LENGTH + 1),
+            last = std::min(index, (long long) _decoded.size() - 1);
+        int dropped = 0;
+        for (long long i = first; i <= last; i++)
+        {
+            DecodedInstruction& instr = _decoded[i];
+            if (instr.opCode != 0 && (i + instr.length > index || instr.fusedLength > index - i))
+            {
+                instr.opCode = 0;
+                dropped++;
+            }
+        }
+        return dropped;
+    }
+
+    void clearDecoded()
+    {
+        _decoded.clear();
+        _decodedChanged.clear();
+    }
+
+    // Hot cells were rewritten while holding code. Instructions covering one
+    // are decoded on every visit and never compiled, the program keeps
+    // changing them. Like the code bitmap, the bits survive resets.
+    void markHot(long long index)
+    {
+        if (index >= (long long) _hotCode.size()) {
+            reserveHot(std::max(index + 1, 2 * (long long) _hotCode.size()));
+        }
+        _hotCode[index] = 1;
+    }
+
+    const unsigned char* reserveHot(long long cells)
+    {
+        if ((long long) _hotCode.size() < cells) {
+            _hotCode.resize(cells, 0);
+        }
+        return _hotCode.data();
+    }
+
+    bool isHot(long long address, int length)
+    {
+        for (long long cell = address; cell < address + length; cell++)
+        {
+            if (cell < (long long) _hotCode.size() && _hotCode[cell]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Reset brings back the image, so only entries decoded from cells that
+    // differed from it are dropped. The rest of the cache stays warm.
+    void dropChangedDecoded()
+    {
+        for (long long address : _decodedChanged)
+        {
+            if (address >= (long long) _decoded.size() || _decoded[address].opCode == 0) {
+                continue;
+            }
+            for (long long cell = address; cell < address + _decoded[address].length; cell++)
+            {
+                markHot(cell);
+                _invalidationStats.decodedEntries += invalidateDecoded(cell);
+            }
+        }
+        _decodedChanged.clear();
+    }
+
+    bool matchesImage(long long address, int length)
+    {
+        for (long long cell = address; cell < address + length; cell++)
+        {
+            const long long loaded = cell < (long long) _intCodeOrig.size() ? _intCodeOrig[cell] : 0;
+            if (_intCode.get(cell) != toCell(loaded)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool fusionActive()
+    {
+        return _fusion && (_backend == Backend::PREDECODED || _backend == Backend::THREADED);
+    }
+
+    // Does operand i of instr read the cell the writer stores to
+    bool readsDestination(const DecodedInstruction& instr, int i, const DecodedInstruction& writer)
+    {
+        return instr.modes[i] != IMMEDIATE_MODE && instr.modes[i] == writer.modes[2] &&
+            instr.operands[i] == writer.operands[2];
+    }
+
+    void fuse(long long address)
+    {
+        DecodedInstruction& first = _decoded[address];
+        const long long next = address + first.length;
+        DecodedInstruction peek;
+        if (first.modes[2] == IMMEDIATE_MODE || next >= (long long) _decoded.size() ||
+            !decodeWord(_intCode.get(next), peek) || isHot(next, peek.length)) {
+            return;
+        }
+
+        bool isCompare = first.opCode == LESS_THAN || first.opCode == EQUALS,
+            nextIsCompare = peek.opCode == LESS_THAN || peek.opCode == EQUALS,
+            nextIsJump = peek.opCode == JUMP_IF_TRUE || peek.opCode == JUMP_IF_FALSE;
+        if (!(isCompare && nextIsJump) && !(first.opCode == ADD && nextIsCompare)) {
+            return;
+        }
+
+        const DecodedInstruction& second = fetchDecoded(next);
+        if (isCompare && readsDestination(second, 0, first)) {
+            first.handler = HANDLER_COMPARE_JUMP;
+        }
+        else if (!isCompare && (readsDestination(second, 0, first) || readsDestination(second, 1, first))) {
+            first.handler = HANDLER_ADD_COMPARE;
+        }
+        else {
+            return;
+        }
+        first.fusedLength = first.length + second.length;
+    }
+
+    // Instructions in the dense region are cached, anything above it and hot
+    // cells are decoded into a scratch entry on every visit. The cache grows
+    // with the code reached, not with memory.
+    const DecodedInstruction& fetchDecoded(long long address)
+    {
+        const bool cached = address >= 0 && address < _intCode.denseSize();
+        if (cached && address >= (long long) _decoded.size())
+        {
+            long long size = std::max(address + Memory::PAGE_SIZE, 2 * (long long) _decoded.size());
+            _decoded.resize(std::min(size, _intCode.denseSize()));
+        }
+
+        DecodedInstruction& instr = cached ? _decoded[address] : _uncachedInstruction;
+        if (cached && instr.opCode != 0) {
+            return instr;
+        }
+
+        const Cell word = _intCode.get(address);
+        if (!decodeWord(word, instr)) {
+            throw std::runtime_error("Unknown opcode " + valueString(word) +
+                " at address " + std::to_string(address));
+        }
+        for (int i = 0; i < instr.length - 1; i++) {
+            instr.operands[i] = getMemoryVal(address + 1 + i);
+        }
+        if (!cached) {
+            return instr;
+        }
+        if (isHot(address, instr.length))
+        {
+            _uncachedInstruction = instr;
+            instr.opCode = 0;
+            return _uncachedInstruction;
+        }
+        if (_optimizedValid) {
+            applyOptimized(address, instr);
+        }
+        markCode(address, address + instr.length);
+        if (!matchesImage(address, instr.length)) {
+            _decodedChanged.push_back(address);
+        }
+        if (fusionActive()) {
+            fuse(address);
+        }
+        return instr;
+    }
+
+    // The optimizer's version of the instruction, if its cells still hold what
+    // was loaded. Only modes and operands differ from the decoded word.
+    void applyOptimized(long long address, DecodedInstruction& instr)
+    {
+#if defined(INTCODE_PROFILE)
+        if (_profiling) {
+            return;
+        }
+#endif
+        const IntcodeInstructionSet::DecodedInstruction* optimized = _optimizer->optimized(address);
+        if (optimized == nullptr) {
+            return;
+        }
+        for (int i = 0; i < instr.length; i++)
+        {
+            if (_intCode.get(address + i) != _intCodeOrig[address + i]) {
+                return;
+            }
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            instr.modes[i] = optimized->modes[i];
+            instr.operands[i] = toCell(optimized->operands[i]);
+        }
+    }
+
+    // Raw word the instruction was decoded from
+    static long long instructionWord(const DecodedInstruction& instr)
+    {
+        return instr.opCode + 100 * instr.modes[0] + 1000 * instr.modes[1] + 10000 * instr.modes[2];
+    }
+
+    long long operandIndex(const DecodedInstruction& instr, int i, long long address)
+    {
+        switch (instr.modes[i])
+        {
+            case POSITION_MODE:
+                return toAddress(instr.operands[i]);
+
+            case IMMEDIATE_MODE:
+                return address + 1 + i;
+
+            case RELATIVE_MODE:
+                return toAddress(_relativeBase + instr.operands[i]);
+
+            default:
+                return -1;
+        };
+    }
+
+    Cell operandValue(const DecodedInstruction& instr, int i, long long address)
+    {
+        if (instr.modes[i] == IMMEDIATE_MODE) {
+            return instr.operands[i];
+        }
+        return getMemoryVal( operandIndex(instr, i, address) );
+    }
+
+    // INPUT has to stop the run instead of reading, it is executed again on resume
+    bool inputBlocked()
+    {
+        if (_input.empty())
+        {
+            _instructionCount--;
+            INTCODE_PROFILE_RETRACT(_instructionPointer);
+            INTCODE_TRACE_EVENT(retract());
+            return true;
+        }
+        return false;
+    }
+
+    Cell readInput()
+    {
+        Cell value = _input.pop();
+        INTCODE_TRACE_EVENT(input(value));
+        LOG_COND(_verbose, "Current input is: " << valueString(value) << std::endl);
+        return value;
+    }
+
+    void writeOutput(Cell output)
+    {
+        LOG_COND(_verbose, "DIAGNOSTICS output: " << valueString(output) << std::endl);
+        INTCODE_TRACE_EVENT(output(output));
+        _output.push(output);
+    }
+
+    Cell arithmeticValue(const DecodedInstruction& instr, long long ip)
+    {
+        Cell first = operandValue(instr, 0, ip), second = operandValue(instr, 1, ip);
+        switch (instr.opCode)
+        {
+            case ADD:
+                return add(first, second);
+
+            case MULT:
+                return multiply(first, second);
+
+            case LESS_THAN:
+                return first < second ? 1 : 0;
+
+            default:
+                return first == second ? 1 : 0;
+        };
+    }
+
+    // Compare and the jump on its result, the jump condition is taken from the
+    // compare instead of being read back from memory
+    void executeCompareJump(const DecodedInstruction& instr, long long ip)
+    {
+        const Cell value = arithmeticValue(instr, ip);
+        const long long next = ip + instr.length;
+        _instructionPointer = next;
+        setMemoryVal(operandIndex(instr, 2, ip), value);
+        if (instr.opCode == 0)
+        {
+            _fusionStats.broken++;
+            return;
+        }
+
+        const DecodedInstruction& jump = _decoded[next];
+        _instructionCount++;
+        _fusionStats.compareJump++;
+        const bool taken = (jump.opCode == JUMP_IF_TRUE) == (value != 0);
+        INTCODE_PROFILE_INSTRUCTION(next, instructionWord(jump));
+        INTCODE_TRACE_EVENT(step(next));
+        INTCODE_PROFILE_JUMP(next, taken);
+        _instructionPointer = taken ? toAddress(operandValue(jump, 1, next)) : next + 3;
+    }
+
+    // Counter update and the compare reading it, continuing into a fused jump
+    void executeAddCompare(const DecodedInstruction& instr, long long ip)
+    {
+        const Cell value = arithmeticValue(instr, ip);
+        const long long next = ip + instr.length;
+        _instructionPointer = next;
+        setMemoryVal(operandIndex(instr, 2, ip), value);
+        const DecodedInstruction& compare = _decoded[next];
+        if (instr.opCode == 0 || compare.opCode == 0)
+        {
+            _fusionStats.broken++;
+            return;
+        }
+
+        _instructionCount++;
+        _fusionStats.addCompare++;
+        INTCODE_PROFILE_INSTRUCTION(next, instructionWord(compare));
+        INTCODE_TRACE_EVENT(step(next));
+        if (compare.handler == HANDLER_COMPARE_JUMP) {
+            executeCompareJump(compare, next);
+        }
+        else
+        {
+            const Cell result = arithmeticValue(compare, next);
+            _instructionPointer = next + compare.length;
+            setMemoryVal(operandIndex(compare, 2, next), result);
+        }
+    }
+
+    enum StepResult
+    {
+        STEP_CONTINUE,
+        STEP_OUTPUT,
+        STEP_HALT,
+        STEP_BLOCKED    // INPUT with an empty input queue, nothing was executed
+    };
+
+    // Where the run loops stop after a step, STEP_CONTINUE never stops
+    static bool stops(StepResult step, bool stopOnOutput, StopReason& reason)
+    {
+        switch (step)
+        {
+            case STEP_OUTPUT:
+                reason = StopReason::OUTPUT;
+                return stopOnOutput;
+
+            case STEP_HALT:
+                reason = StopReason::HALTED;
+                return true;
+
+            case STEP_BLOCKED:
+                reason = StopReason::NEED_INPUT;
+                return true;
+
+            default:
+                return false;
+        };
+    }
+
+    // Executes the decoded instruction at the instruction pointer
+    StepResult stepDecoded()
+    {
+        const long long ip = _instructionPointer;
+        const DecodedInstruction& instr = fetchDecoded(ip);
+        _instructionCount++;
+        INTCODE_PROFILE_INSTRUCTION(ip, instructionWord(instr));
+        INTCODE_TRACE_EVENT(step(ip));
+
+        // Operands are consumed before the write, which may invalidate instr
+        switch (instr.handler)
+        {
+            case HANDLER_COMPARE_JUMP:
+                executeCompareJump(instr, ip);
+                return STEP_CONTINUE;
+
+            case HANDLER_ADD_COMPARE:
+                executeAddCompare(instr, ip);
+                return STEP_CONTINUE;
+
+            case ADD:
+            {
+                Cell value = add(operandValue(instr, 0, ip), operandValue(instr, 1, ip));
+                _instructionPointer = ip + 4;
+                setMemoryVal(operandIndex(instr, 2, ip), value);
+                return STEP_CONTINUE;
+            }
+
+            case MULT:
+            {
+                Cell value = multiply(operandValue(instr, 0, ip), operandValue(instr, 1, ip));
+                _instructionPointer = ip + 4;
+                setMemoryVal(operandIndex(instr, 2, ip), value);
+                return STEP_CONTINUE;
+            }
+
+            case LESS_THAN:
+            {
+                Cell value = operandValue(instr, 0, ip) < operandValue(instr, 1, ip) ? 1 : 0;
+                _instructionPointer = ip + 4;
+                setMemoryVal(operandIndex(instr, 2, ip), value);
+                return STEP_CONTINUE;
+            }
+
+            case EQUALS:
+            {
+                Cell value = operandValue(instr, 0, ip) == operandValue(instr, 1, ip) ? 1 : 0;
+                _instructionPointer = ip + 4;
+                setMemoryVal(operandIndex(instr, 2, ip), value);
+                return STEP_CONTINUE;
+            }
+
+            case JUMP_IF_TRUE:
+                INTCODE_PROFILE_JUMP(ip, operandValue(instr, 0, ip) != 0);
+                _instructionPointer = operandValue(instr, 0, ip) != 0 ?
+                    toAddress(operandValue(instr, 1, ip)) : ip + 3;
+                return STEP_CONTINUE;
+
+            case JUMP_IF_FALSE:
+                INTCODE_PROFILE_JUMP(ip, operandValue(instr, 0, ip) == 0);
+                _instructionPointer = operandValue(instr, 0, ip) == 0 ?
+                    toAddress(operandValue(instr, 1, ip)) : ip + 3;
+                return STEP_CONTINUE;
+
+            case BASE_OP:
+                _relativeBase = toAddress(_relativeBase + operandValue(instr, 0, ip));
+                INTCODE_TRACE_EVENT(base(_relativeBase));
+                _instructionPointer = ip + 2;
+                return STEP_CONTINUE;
+
+            case INPUT:
+            {
+                if (inputBlocked()) {
+                    return STEP_BLOCKED;
+                }
+                long long index = operandIndex(instr, 0, ip);
+                Cell value = readInput();
+                _instructionPointer = ip + 2;
+                setMemoryVal(index, value);
+                return STEP_CONTINUE;
+            }
+
+            case OUTPUT:
+                writeOutput(operandValue(instr, 0, ip));
+                _instructionPointer = ip + 2;
+                return STEP_OUTPUT;
+
+            default:
+                _halted = true;
+                LOG_COND(_verbose, "Computer halted\n");
+                return STEP_HALT;
+        };
+    }
+
+    StopReason calculate_predecoded(bool stopOnOutput)
+    {
+        StopReason reason;
+        while (_intCode.reached(_instructionPointer))
+        {
+            if (budgetExhausted()) {
+                return StopReason::BUDGET_EXHAUSTED;
+            }
+            if (stops(stepDecoded(), stopOnOutput, reason)) {
+                return reason;
+            }
+        }
+        return endOfMemory();
+    }
+
+    // Runs compiled blocks where possible and steps the predecoded interpreter
+    // over everything the JIT leaves out (I/O, halt, out of range accesses)
+    StopReason calculate_jit(bool stopOnOutput)
+    {
+#if defined(INTCODE_JIT_AVAILABLE)
+        StopReason reason;
+        bool interpretNext = false;
+        while (_intCode.reached(_instructionPointer))
+        {
+            if (budgetExhausted()) {
+                return StopReason::BUDGET_EXHAUSTED;
+            }
+
+            bool compiled = false;
+            void* code = interpretNext || (unsigned long long) _instructionPointer >= (unsigned long long) _intCode.denseSize() ? nullptr :
+                _jit.blockAt(_instructionPointer, _intCode.dense(), _intCode.denseSize(), &compiled, reserveHot(_intCode.denseSize()));
+            if (compiled) {
+                markCode(_instructionPointer, _jit.blockEnd(_instructionPointer));
+            }
+            if (code != nullptr)
+            {
+                IntcodeJit::State state {};
+                state.memory = _intCode.dense();
+                state.memorySize = _intCode.denseSize();
+                state.codeBits = reserveCodeBits(_intCode.denseSize());
+                state.relativeBase = _relativeBase;
+                state.instructionCount = _instructionCount;
+                state.instructionLimit = _instructionLimit;
+
+                IntcodeJit::ExitReason exit = _jit.run(code, state);
+                _intCode.touchDense();
+                _instructionPointer = state.instructionPointer;
+                _relativeBase = state.relativeBase;
+                _instructionCount = state.instructionCount;
+                if (exit == IntcodeJit::EXIT_CODE_WRITE) {
+                    codeWritten(state.writeAddress);
+                }
+                interpretNext = exit == IntcodeJit::EXIT_INTERPRET;
+                continue;
+            }
+
+            interpretNext = false;
+            if (stops(stepDecoded(), stopOnOutput, reason)) {
+                return reason;
+            }
+        }
+        return endOfMemory();
+#else
+        return calculate_predecoded(stopOnOutput);
+#endif
+    }
+
+    // Runs the translated program, the predecoded interpreter handles I/O and
+    // the blocks whose code was modified
+    StopReason calculate_native(bool stopOnOutput)
+    {
+        if (_native == nullptr) {
+            throw std::runtime_error("Native backend selected without a native program");
+        }
+
+        StopReason reason;
+        bool interpretNext = false;
+        while (_intCode.reached(_instructionPointer))
+        {
+            if (budgetExhausted()) {
+                return StopReason::BUDGET_EXHAUSTED;
+            }
+
+            if (!interpretNext)
+            {
+                IntcodeNative::State state {};
+                state.memory = _intCode.dense();
+                state.memorySize = _intCode.denseSize();
+                state.codeBits = reserveCodeBits(_intCode.denseSize());
+                state.staleBlocks = _nativeStale.data();
+                state.relativeBase = _relativeBase;
+                state.instructionPointer = _instructionPointer;
+                state.instructionCount = _instructionCount;
+                state.instructionLimit = _instructionLimit;
+
+                IntcodeNative::ExitReason exit = _native->run(state);
+                _intCode.touchDense();
+                _instructionPointer = state.instructionPointer;
+                _relativeBase = state.relativeBase;
+                _instructionCount = state.instructionCount;
+                if (exit == IntcodeNative::EXIT_CODE_WRITE) {
+                    codeWritten(state.writeAddress);
+                }
+                interpretNext = exit == IntcodeNative::EXIT_INTERPRET;
+                continue;
+            }
+
+            interpretNext = false;
+            if (stops(stepDecoded(), stopOnOutput, reason)) {
+                return reason;
+            }
+        }
+        return endOfMemory();
+    }
+
+    // Same semantics as calculate_predecoded, but every handler jumps straight
+    // to the next one through a labels-as-values table (GCC/Clang extension)
+    StopReason calculate_threaded(bool stopOnOutput)
+    {
+#if defined(__GNUC__)
+        static void* const dispatchTable[] = {
+            &&op_invalid, &&op_add, &&op_mult, &&op_input, &&op_output,
+            &&op_jump_if_true, &&op_jump_if_false, &&op_less_than, &&op_equals,
+            &&op_base, &&op_halt, &&op_compare_jump, &&op_add_compare
+        };
+
+        long long ip = 0;
+        StopReason reason = StopReason::HALTED;
+        const DecodedInstruction* instr = nullptr;
+
+#define THREADED_DISPATCH()                                                             \
+        if (!_intCode.reached(_instructionPointer)) return endOfMemory();               \
+        if (budgetExhausted()) return StopReason::BUDGET_EXHAUSTED;                     \
+        ip = _instructionPointer;                                                       \
+        instr = &fetchDecoded(ip);                                                      \
+        _instructionCount++;                                                            \
+        INTCODE_PROFILE_INSTRUCTION(ip, instructionWord(*instr));                       \
+        INTCODE_TRACE_EVENT(step(ip));                                                  \
+        goto *dispatchTable[instr->handler];
+
+        THREADED_DISPATCH();
+
+    op_add:
+    {
+        Cell value = add(operandValue(*instr, 0, ip), operandValue(*instr, 1, ip));
+        _instructionPointer = ip + 4;
+        setMemoryVal(operandIndex(*instr, 2, ip), value);
+        THREADED_DISPATCH();
+    }
+
+    op_mult:
+    {
+        Cell value = multiply(operandValue(*instr, 0, ip), operandValue(*instr, 1, ip));
+        _instructionPointer = ip + 4;
+        setMemoryVal(operandIndex(*instr, 2, ip), value);
+        THREADED_DISPATCH();
+    }
+
+    op_less_than:
+    {
+        Cell value = operandValue(*instr, 0, ip) < operandValue(*instr, 1, ip) ? 1 : 0;
+        _instructionPointer = ip + 4;
+        setMemoryVal(operandIndex(*instr, 2, ip), value);
+        THREADED_DISPATCH();
+    }
+
+    op_equals:
+    {
+        Cell value = operandValue(*instr, 0, ip) == operandValue(*instr, 1, ip) ? 1 : 0;
+        _instructionPointer = ip + 4;
+        setMemoryVal(operandIndex(*instr, 2, ip), value);
+        THREADED_DISPATCH();
+    }
+
+    op_compare_jump:
+        executeCompareJump(*instr, ip);
+        THREADED_DISPATCH();
+
+    op_add_compare:
+        executeAddCompare(*instr, ip);
+        THREADED_DISPATCH();
+
+    op_jump_if_true:
+        INTCODE_PROFILE_JUMP(ip, operandValue(*instr, 0, ip) != 0);
+        _instructionPointer = operandValue(*instr, 0, ip) != 0 ?
+            toAddress(operandValue(*instr, 1, ip)) : ip + 3;
+        THREADED_DISPATCH();
+
+    op_jump_if_false:
+        INTCODE_PROFILE_JUMP(ip, operandValue(*instr, 0, ip) == 0);
+        _instructionPointer = operandValue(*instr, 0, ip) == 0 ?
+            toAddress(operandValue(*instr, 1, ip)) : ip + 3;
+        THREADED_DISPATCH();
+
+    op_base:
+        _relativeBase = toAddress(_relativeBase + operandValue(*instr, 0, ip));
+        INTCODE_TRACE_EVENT(base(_relativeBase));
+        _instructionPointer = ip + 2;
+        THREADED_DISPATCH();
+
+    op_input:
+    {
+        if (inputBlocked())
+        {
+            reason = StopReason::NEED_INPUT;
+            goto done;
+        }
+        long long index = operandIndex(*instr, 0, ip);
+        Cell value = readInput();
+        _instructionPointer = ip + 2;
+        setMemoryVal(index, value);
+        THREADED_DISPATCH();
+    }
+
+    op_output:
+        writeOutput(operandValue(*instr, 0, ip));
+        _instructionPointer = ip + 2;
+        if (stopOnOutput)
+        {
+            reason = StopReason::OUTPUT;
+            goto done;
+        }
+        THREADED_DISPATCH();
+
+    op_halt:
+        _halted = true;
+        LOG_COND(_verbose, "Computer halted\n");
+        reason = StopReason::HALTED;
+        goto done;
+
+    op_invalid:
+        throw std::runtime_error("Threaded dispatch reached an undecoded instruction");
+
+#undef THREADED_DISPATCH
+
+    done:
+        return reason;
+#else
+        return calculate_predecoded(stopOnOutput);
+#endif
+    }
+
+    StopReason calculate_reference(bool stopOnOutput)
     {
-        long long output = -1;
-        bool outputSet = false;
         //std::printf ("Amp input %d, Amp phase %d\n", ampInput, ampPhase);
-        while (_instructionPointer < _intCode.size())
+        while (_intCode.reached(_instructionPointer))
         {   
-            int paramMode3 = _intCode[_instructionPointer] / 10000,
-                paramMode2 = (_intCode[_instructionPointer] % 10000) / 1000,
-                paramMode1 = (_intCode[_instructionPointer] % 1000 ) / 100,
-                opCode = _intCode[_instructionPointer] % 100;
+            if (budgetExhausted()) {
+                return StopReason::BUDGET_EXHAUSTED;
+            }
+            _instructionCount++;
+            const Cell word = getMemoryVal(_instructionPointer);
+            INTCODE_PROFILE_INSTRUCTION(_instructionPointer, word);
+            INTCODE_TRACE_EVENT(step(_instructionPointer));
+            int paramMode3 = word / 10000,
+                paramMode2 = (word % 10000) / 1000,
+                paramMode1 = (word % 1000 ) / 100,
+                opCode = word % 100;
 
             // assume index is at operation code
             if (opCode == HALT)
             {
                 _halted = true;
                 LOG_COND(_verbose, "Computer halted\n");
-                break;
+                return StopReason::HALTED;
             }
 
             if (opCode == INPUT)
             {   
-                if (takeUserInput)
-                {
-                    LOG_COND(_verbose, "Please input number: ");
-                    std::cin >> input;
+                if (inputBlocked()) {
+                    return StopReason::NEED_INPUT;
                 }
-
-                LOG_COND(_verbose, "Current input is: " << input << std::endl);
-                setMemoryVal(  getArgIndex(paramMode1, _instructionPointer + 1), input);
+                Cell value = readInput();
+                setMemoryVal(  getArgIndex(paramMode1, _instructionPointer + 1), value);
                 _instructionPointer += 2;
             }
             else if (opCode == OUTPUT)
             {
-                output = getMemoryVal( getArgIndex(paramMode1, _instructionPointer + 1) );
-                LOG_COND(_verbose, "DIAGNOSTICS output: " << output << std::endl);
+                writeOutput( getMemoryVal( getArgIndex(paramMode1, _instructionPointer + 1) ) );
                 _instructionPointer += 2;
-                outputSet = true;
-                if (returnOnOutput) {
-                    break;
+                if (stopOnOutput) {
+                    return StopReason::OUTPUT;
                 }
             }
             else if (opCode == BASE_OP)
             {
-                _relativeBase += getMemoryVal( getArgIndex(paramMode1, _instructionPointer + 1) );
+                _relativeBase = toAddress(_relativeBase + getMemoryVal( getArgIndex(paramMode1, _instructionPointer + 1) ));
+                INTCODE_TRACE_EVENT(base(_relativeBase));
                 _instructionPointer += 2;
             }
             else if (opCode == JUMP_IF_TRUE || opCode == JUMP_IF_FALSE)
             {
-                int firstArg = getMemoryVal( getArgIndex(paramMode1, _instructionPointer + 1) );
-                int secondArg = getMemoryVal( getArgIndex(paramMode2, _instructionPointer + 2) );
+                Cell firstArg = getMemoryVal( getArgIndex(paramMode1, _instructionPointer + 1) );
+                Cell secondArg = getMemoryVal( getArgIndex(paramMode2, _instructionPointer + 2) );
+                INTCODE_PROFILE_JUMP(_instructionPointer, (opCode == JUMP_IF_TRUE) == (firstArg != 0));
                 
                 if ( (opCode == JUMP_IF_TRUE && firstArg != 0) ||
                      (opCode == JUMP_IF_FALSE && firstArg == 0)) {
-                    _instructionPointer = secondArg;
+                    _instructionPointer = toAddress(secondArg);
                 }
                 else {
                     _instructionPointer += 3;
@@ -191,7 +1391,7 @@ private:
             }
             else
             {
-                int firstArgIndex = getArgIndex(paramMode1, _instructionPointer + 1),
+                long long firstArgIndex = getArgIndex(paramMode1, _instructionPointer + 1),
                     secondArgIndex = getArgIndex(paramMode2, _instructionPointer + 2),
                     resultIndex = getArgIndex(paramMode3, _instructionPointer + 3);
 
@@ -204,19 +1404,43 @@ private:
                 _instructionPointer += 4;
             }
         }
-
-        if (outputSet) {
-            _lastOutput = output;
-        }
-        return output;
+        return endOfMemory();
     }
 
-    int _index = -1, _lastOutput = -1, _instructionPointer = 0, _relativeBase = 0;
+    long long _instructionPointer = 0, _relativeBase = 0;
     bool _halted = false;
     bool _verbose = true;
-    std::vector<long long> _intCode;
-    const std::vector<long long> _intCodeOrig;
-    std::map < long long, std::function<long long(long long, long long)> > _operationsMap;
+    unsigned long long _instructionCount = 0;
+    unsigned long long _instructionLimit = NO_BUDGET;   // Count at which the current run stops
+    Backend _backend = defaultBackend();
+    IntcodeRingBuffer<Cell> _input, _output;
+    std::vector<DecodedInstruction> _decoded;
+    std::vector<long long> _decodedChanged;     // Cached entries decoded from cells that differ from the image
+    std::vector<unsigned char> _hotCode;        // Per cell, see markHot
+    DecodedInstruction _uncachedInstruction;
+    bool _fusion = true;
+    FusionStats _fusionStats;
+    std::vector<unsigned long long> _codeBits;
+    InvalidationStats _invalidationStats;
+    const IntcodeNative::Program* _native = nullptr;
+    std::vector<unsigned char> _nativeStale;    // Per translated block, set once its code changed
+    std::shared_ptr<const IntcodeOptimizer> _optimizer;    // Shared by forks
+    bool _optimizedValid = false;
+#if defined(INTCODE_JIT_AVAILABLE)
+    IntcodeJit _jit;
+#endif
+#if defined(INTCODE_PROFILE)
+    bool _profiling = false;
+    IntcodeProfile _profile;
+#endif
+#if defined(INTCODE_TRACE)
+    IntcodeTraceRecorder* _trace = nullptr;
+#endif
+    Memory _intCode;
+    const std::vector<long long> _intCodeOrig;     // Image as loaded
+    std::map < long long, std::function<Cell(Cell, Cell)> > _operationsMap;
 };
 
+typedef BasicIntcodeComputer<long long> IntcodeComputer;
+
 #endif /* INTCODE_COMPUTER_HPP */
\ No newline at end of file
@@ -0,0 +1,244 @@
+#ifndef INTCODE_CONSTEXPR_HPP
+#define INTCODE_CONSTEXPR_HPP
+
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include "intcode_instruction_set.hpp"
+
+// Intcode machine that runs inside constant evaluation, for programs and
+// inputs known when the binary is built. The puzzle text is a valid
+// initializer list, so the image can be included straight into the source:
+//
+//   constexpr long long image[] = {
+//   #include "day02.txt"
+//   };
+//   constexpr long long position0 = [] {
+//       IntcodeConstexpr<sizeof(image) / sizeof(image[0])> ic(image);
+//       ic.run({});
+//       return ic.getMemory(0);
+//   }();
+//
+// The same code runs at runtime when the result is not needed as a constant.
+// Memory is a fixed array of Capacity cells and at most MaxOutputs outputs
+// are kept. Every failure (step limit, unknown opcode, address outside of
+// memory, missing input, too many outputs) goes through a function that is
+// not constexpr: during constant evaluation the build stops with the name of
+// that function in the diagnostic, at runtime it throws std::runtime_error.
+//
+// Compilers limit constant evaluation on their own as well: GCC to 2^25
+// operations (-fconstexpr-ops-limit), Clang to 2^20 steps (-fconstexpr-steps).
+// An instruction costs GCC around 600 of them, DEFAULT_STEP_LIMIT keeps the
+// step limit diagnostic ahead of the compiler's. Larger limits need the
+// compiler's raised as well.
+template <size_t Capacity, size_t MaxOutputs = 64>
+class IntcodeConstexpr : private IntcodeInstructionSet
+{
+public:
+    static constexpr unsigned long long DEFAULT_STEP_LIMIT = 20000;
+
+    template <size_t Size>
+    constexpr explicit IntcodeConstexpr(const long long (&image)[Size])
+    {
+        static_assert(Size <= Capacity, "Intcode image does not fit the memory of the machine");
+        for (size_t i = 0; i < Size; i++) {
+            _memory[i] = image[i];
+        }
+        _size = Size;
+    }
+
+    constexpr long long getMemory(long long address) const
+    {
+        checkAddress(address);
+        return _memory[address];
+    }
+
+    constexpr void setMemory(long long address, long long value)
+    {
+        set(address, value);
+    }
+
+    // Runs until the program halts, INPUT takes the inputs in order
+    constexpr void run(std::initializer_list<long long> inputs, unsigned long long stepLimit = DEFAULT_STEP_LIMIT)
+    {
+        const long long* input = inputs.begin();
+        while (!_halted)
+        {
+            // Running past the last cell ends the program like a HALT, as in IntcodeComputer
+            if (_instructionPointer >= (long long) _size)
+            {
+                _halted = true;
+                break;
+            }
+            if (_steps == stepLimit) {
+                stepLimitExceeded(stepLimit);
+            }
+            _steps++;
+
+            const long long ip = _instructionPointer;
+            DecodedInstruction instr;
+            if (!decodeWord(get(ip), instr)) {
+                unknownOpcode(get(ip), ip);
+            }
+            for (int i = 0; i < instr.length - 1; i++) {
+                instr.operands[i] = get(ip + 1 + i);
+            }
+            _instructionPointer = ip + instr.length;
+
+            switch (instr.opCode)
+            {
+                case ADD:
+                    set(operandIndex(instr, 2, ip), operandValue(instr, 0, ip) + operandValue(instr, 1, ip));
+                    break;
+
+                case MULT:
+                    set(operandIndex(instr, 2, ip), operandValue(instr, 0, ip) * operandValue(instr, 1, ip));
+                    break;
+
+                case LESS_THAN:
+                    set(operandIndex(instr, 2, ip), operandValue(instr, 0, ip) < operandValue(instr, 1, ip) ? 1 : 0);
+                    break;
+
+                case EQUALS:
+                    set(operandIndex(instr, 2, ip), operandValue(instr, 0, ip) == operandValue(instr, 1, ip) ? 1 : 0);
+                    break;
+
+                case JUMP_IF_TRUE:
+                    if (operandValue(instr, 0, ip) != 0) {
+                        _instructionPointer = operandValue(instr, 1, ip);
+                    }
+                    break;
+
+                case JUMP_IF_FALSE:
+                    if (operandValue(instr, 0, ip) == 0) {
+                        _instructionPointer = operandValue(instr, 1, ip);
+                    }
+                    break;
+
+                case BASE_OP:
+                    _relativeBase += operandValue(instr, 0, ip);
+                    break;
+
+                case INPUT:
+                    if (input == inputs.end()) {
+                        inputExhausted(inputs.size());
+                    }
+                    set(operandIndex(instr, 0, ip), *input++);
+                    break;
+
+                case OUTPUT:
+                    if (_outputCount == MaxOutputs) {
+                        outputsExceeded(MaxOutputs);
+                    }
+                    _outputs[_outputCount++] = operandValue(instr, 0, ip);
+                    break;
+
+                default:
+                    _halted = true;
+                    break;
+            };
+        }
+    }
+
+    constexpr size_t outputCount() const { return _outputCount; }
+    constexpr long long output(size_t i) const { return _outputs[i]; }
+    constexpr long long lastOutput() const { return _outputCount == 0 ? -1 : _outputs[_outputCount - 1]; }
+
+    constexpr unsigned long long steps() const { return _steps; }
+    constexpr bool isHalted() const { return _halted; }
+
+private:
+
+    constexpr long long get(long long address)
+    {
+        checkAddress(address);
+        grow(address);
+        return _memory[address];
+    }
+
+    constexpr void set(long long address, long long value)
+    {
+        checkAddress(address);
+        grow(address);
+        _memory[address] = value;
+    }
+
+    // One past the highest address accessed, where the program ends
+    constexpr void grow(long long address)
+    {
+        if (address >= (long long) _size) {
+            _size = address + 1;
+        }
+    }
+
+    constexpr void checkAddress(long long address) const
+    {
+        if (address < 0 || address >= (long long) Capacity) {
+            addressOutOfRange(address, Capacity);
+        }
+    }
+
+    constexpr long long operandIndex(const DecodedInstruction& instr, int i, long long address) const
+    {
+        switch (instr.modes[i])
+        {
+            case POSITION_MODE:
+                return instr.operands[i];
+
+            case IMMEDIATE_MODE:
+                return address + 1 + i;
+
+            default:
+                return _relativeBase + instr.operands[i];
+        };
+    }
+
+    constexpr long long operandValue(const DecodedInstruction& instr, int i, long long address)
+    {
+        if (instr.modes[i] == IMMEDIATE_MODE) {
+            return instr.operands[i];
+        }
+        return get(operandIndex(instr, i, address));
+    }
+
+    // Failures, not constexpr on purpose
+
+    [[noreturn]] static void stepLimitExceeded(unsigned long long limit)
+    {
+        throw std::runtime_error("Intcode step limit of " + std::to_string(limit) + " exceeded");
+    }
+
+    [[noreturn]] static void unknownOpcode(long long word, long long address)
+    {
+        throw std::runtime_error("Unknown opcode " + std::to_string(word) + " at address " + std::to_string(address));
+    }
+
+    [[noreturn]] static void addressOutOfRange(long long address, size_t capacity)
+    {
+        throw std::runtime_error("Intcode address " + std::to_string(address) + " outside of the " +
+            std::to_string(capacity) + " cells of the machine");
+    }
+
+    [[noreturn]] static void inputExhausted(size_t given)
+    {
+        throw std::runtime_error("Intcode program wants more than the " + std::to_string(given) + " inputs given");
+    }
+
+    [[noreturn]] static void outputsExceeded(size_t kept)
+    {
+        throw std::runtime_error("Intcode program produced more than " + std::to_string(kept) + " outputs");
+    }
+
+    std::array<long long, Capacity> _memory {};
+    std::array<long long, MaxOutputs> _outputs {};
+    size_t _outputCount = 0;
+    size_t _size = 0;
+    long long _instructionPointer = 0;
+    long long _relativeBase = 0;
+    unsigned long long _steps = 0;
+    bool _halted = false;
+};
+
+#endif /* INTCODE_CONSTEXPR_HPP */
@@ -0,0 +1,212 @@
+#ifndef INTCODE_COROUTINE_HPP
+#define INTCODE_COROUTINE_HPP
+
+#include <coroutine>
+#include <optional>
+#include <vector>
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include "intcode_computer.hpp"
+
+// Coroutine frames come from per-thread free lists bucketed by size, so
+// starting one program coroutine after another reuses the same memory
+class IntcodeFramePool
+{
+public:
+    static void* allocate(size_t size)
+    {
+        std::vector<void*>& frames = freeList(size);
+        if (frames.empty()) {
+            return ::operator new(roundUp(size));
+        }
+        void* frame = frames.back();
+        frames.pop_back();
+        return frame;
+    }
+
+    static void deallocate(void* frame, size_t size)
+    {
+        freeList(size).push_back(frame);
+    }
+
+private:
+
+    static const size_t GRANULE = 64;
+
+    struct FreeLists
+    {
+        ~FreeLists()
+        {
+            for (auto& frames : buckets)
+            for (void* frame : frames) {
+                ::operator delete(frame);
+            }
+        }
+
+        std::vector< std::vector<void*> > buckets;
+    };
+
+    static size_t roundUp(size_t size) { return (size + GRANULE - 1) / GRANULE * GRANULE; }
+
+    static std::vector<void*>& freeList(size_t size)
+    {
+        thread_local FreeLists lists;
+        const size_t bucket = roundUp(size) / GRANULE;
+        if (lists.buckets.size() <= bucket) {
+            lists.buckets.resize(bucket + 1);
+        }
+        return lists.buckets[bucket];
+    }
+};
+
+// IntcodeComputer driven as a coroutine: the program yields its outputs and
+// co_awaits a value on every INPUT, so the caller reads like a plain loop
+//
+//   IntcodeCoroutine robot = IntcodeCoroutine::start(ic);
+//   robot.input(color);
+//   auto newColor = robot.output();
+//
+// The coroutine runs on the computer's own state, restoring a snapshot of the
+// computer between calls is fine.
+class IntcodeCoroutine
+{
+public:
+
+    struct promise_type;
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    // Awaited by the program for the next input
+    struct Input { };
+
+    struct InputAwaiter
+    {
+        promise_type& promise;
+
+        bool await_ready() { return promise.input.has_value(); }
+
+        void await_suspend(Handle) { promise.waitingForInput = true; }
+
+        long long await_resume()
+        {
+            long long value = *promise.input;
+            promise.input.reset();
+            promise.waitingForInput = false;
+            return value;
+        }
+    };
+
+    struct promise_type
+    {
+        long long value = 0;                // Last output
+        std::optional<long long> input;     // Given by the caller, not consumed yet
+        bool waitingForInput = false;
+        std::exception_ptr exception;
+
+        IntcodeCoroutine get_return_object() { return IntcodeCoroutine(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(long long output) noexcept
+        {
+            value = output;
+            return {};
+        }
+        InputAwaiter await_transform(Input) { return InputAwaiter {*this}; }
+        void return_void() { }
+        void unhandled_exception() { exception = std::current_exception(); }
+
+        static void* operator new(size_t size) { return IntcodeFramePool::allocate(size); }
+        static void operator delete(void* frame, size_t size) { IntcodeFramePool::deallocate(frame, size); }
+    };
+
+    // Runs the program on ic until it halts
+    static IntcodeCoroutine start(IntcodeComputer& ic)
+    {
+        while (true)
+        {
+            switch (ic.step())
+            {
+                case IntcodeComputer::StopReason::OUTPUT:
+                    co_yield ic.popOutput();
+                    break;
+
+                case IntcodeComputer::StopReason::NEED_INPUT:
+                    ic.pushInput(co_await Input {});
+                    break;
+
+                case IntcodeComputer::StopReason::BUDGET_EXHAUSTED:
+                    break;
+
+                default:
+                    co_return;
+            };
+        }
+    }
+
+    IntcodeCoroutine(IntcodeCoroutine&& other) noexcept : _handle(other._handle)
+    {
+        other._handle = nullptr;
+    }
+
+    IntcodeCoroutine& operator=(IntcodeCoroutine&& other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            _handle = other._handle;
+            other._handle = nullptr;
+        }
+        return *this;
+    }
+
+    ~IntcodeCoroutine()
+    {
+        destroy();
+    }
+
+    // Value for the next INPUT the program executes, one can be pending at a time
+    void input(long long value)
+    {
+        if (_handle.promise().input.has_value()) {
+            throw std::logic_error("Previous Intcode input was not consumed yet");
+        }
+        _handle.promise().input = value;
+    }
+
+    // Runs to the next output, nothing once the program halted or while it
+    // waits for an input that was not given
+    std::optional<long long> output()
+    {
+        promise_type& promise = _handle.promise();
+        if (_handle.done() || (promise.waitingForInput && !promise.input.has_value())) {
+            return std::nullopt;
+        }
+
+        _handle.resume();
+        if (promise.exception) {
+            std::rethrow_exception(promise.exception);
+        }
+        if (_handle.done() || promise.waitingForInput) {
+            return std::nullopt;
+        }
+        return promise.value;
+    }
+
+    bool waitingForInput() { return _handle.promise().waitingForInput && !_handle.promise().input.has_value(); }
+    bool done() { return _handle.done(); }
+
+private:
+
+    explicit IntcodeCoroutine(Handle handle) : _handle(handle) { }
+
+    void destroy()
+    {
+        if (_handle) {
+            _handle.destroy();
+        }
+    }
+
+    Handle _handle;
+};
+
+#endif /* INTCODE_COROUTINE_HPP */
@@ -0,0 +1,60 @@
+#include "intcode_disassembler.hpp"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <cstdio>
+
+// Prints the disassembly of an Intcode program with its basic blocks and
+// loops, and writes the control-flow graph for Graphviz when asked to.
+//
+//   intcode_disasm day13.txt [day13.dot]
+//   dot -Tsvg day13.dot -o day13.svg
+int main (int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <program.txt> [output.dot]" << std::endl;
+        return 1;
+    }
+
+    std::fstream inputFile(argv[1]);
+    if (!inputFile)
+    {
+        std::cerr << "Unable to open " << argv[1] << std::endl;
+        return 1;
+    }
+    IntcodeDisassembler disassembler(std::move(inputFile));
+    disassembler.writeListing(std::cout);
+
+    size_t codeCells = 0;
+    for (auto& region : disassembler.regions()) {
+        if (region.code) codeCells += region.end - region.begin;
+    }
+    std::printf("\n%zu cells, %zu code, %zu instructions in %zu blocks, %zu entries, %zu loops\n",
+        disassembler.image().size(), codeCells, disassembler.instructions().size(), disassembler.blocks().size(),
+        disassembler.entries().size(), disassembler.loops().size());
+    for (auto& loop : disassembler.loops())
+    {
+        const auto& header = disassembler.blocks().at(loop.header);
+        std::printf("  loop at %lld, %zu blocks, depth %d\n", loop.header, loop.blocks.size(), header.loopDepth);
+    }
+
+    if (argc > 2)
+    {
+        std::ofstream out(argv[2]);
+        if (!out)
+        {
+            std::cerr << "Unable to open " << argv[2] << std::endl;
+            return 1;
+        }
+        disassembler.writeDot(out);
+        out.close();
+        if (!out)
+        {
+            std::cerr << "Unable to write " << argv[2] << std::endl;
+            return 1;
+        }
+        std::printf("Wrote the control-flow graph to %s\n", argv[2]);
+    }
+    return 0;
+}
@@ -0,0 +1,590 @@
+#ifndef INTCODE_DISASSEMBLER_HPP
+#define INTCODE_DISASSEMBLER_HPP
+
+#include <map>
+#include <set>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <ostream>
+#include <algorithm>
+#include "intcode_instruction_set.hpp"
+#include "intcode_loader.hpp"
+
+// Static view of an Intcode image: which cells are code and which are data,
+// the basic blocks the code splits into, the control-flow graph between them
+// and the loops in it, without running the program.
+//
+// Code is found by following control flow from address 0. Jumps with an
+// immediate target are followed, jumps through memory are not, so the
+// addresses programs push before calling a function (ADD or MULT of two
+// immediates, the usual "return address" idiom) and the initial contents of
+// cells jumped through are tried as extra entry points. Anything not reached
+// either way is data. A block that pushes such an address and then jumps is
+// taken to be a call and gets an edge to the address as well, so loops
+// around calls show up in the graph.
+class IntcodeDisassembler : private IntcodeInstructionSet
+{
+public:
+
+    struct Instruction
+    {
+        long long address = 0;
+        long long word = 0;
+        DecodedInstruction decoded;
+        bool writesCode = false;    // Stores to a fixed address inside the code, the program modifies itself
+    };
+
+    struct Block
+    {
+        long long begin = 0;
+        long long end = 0;                      // One past the last cell of the last instruction
+        std::vector<long long> instructions;    // Addresses
+        std::vector<long long> successors;      // Block addresses, taken target first
+        std::vector<long long> predecessors;
+        bool indirect = false;      // Ends in a jump through memory, where it goes is not known statically
+        bool halts = false;
+        bool fallsOff = false;      // Runs into a cell that does not decode
+        long long returnsTo = -1;   // Call: pushes this address and jumps away, the callee comes back there
+        int loopDepth = 0;
+    };
+
+    struct Loop
+    {
+        long long header = 0;
+        std::set<long long> blocks;
+    };
+
+    struct Region
+    {
+        long long begin = 0;
+        long long end = 0;
+        bool code = false;
+    };
+
+    explicit IntcodeDisassembler(std::fstream&& intCodeFileStream) :
+        IntcodeDisassembler(IntcodeLoader::load(intCodeFileStream))
+    { }
+
+    explicit IntcodeDisassembler(std::vector<long long> image)
+        :_image(image), _code(image.size(), 0)
+    {
+        discover();
+        buildBlocks();
+        findLoops();
+    }
+
+    const std::vector<long long>& image() const { return _image; }
+    const std::map<long long, Instruction>& instructions() const { return _instructions; }
+    const std::map<long long, Block>& blocks() const { return _blocks; }
+    const std::vector<Loop>& loops() const { return _loops; }
+    const std::set<long long>& entries() const { return _entries; }         // 0 and the inferred entry points
+    const std::set<long long>& jumpTargets() const { return _targets; }     // Immediate jump targets
+
+    bool isCode(long long address) const
+    {
+        return address >= 0 && address < (long long) _code.size() && _code[address];
+    }
+
+    // Maximal runs of code cells and of data cells, in address order
+    std::vector<Region> regions() const
+    {
+        std::vector<Region> regions;
+        for (long long address = 0; address < (long long) _code.size(); address++)
+        {
+            if (regions.empty() || regions.back().code != (bool) _code[address])
+            {
+                Region region;
+                region.begin = address;
+                region.code = _code[address];
+                regions.push_back(region);
+            }
+            regions.back().end = address + 1;
+        }
+        return regions;
+    }
+
+    // "ADD [rb+1], 5, [100]" with [x] a cell read or written and a bare number an immediate
+    std::string describe(const Instruction& instr) const
+    {
+        std::string text = name(instr.decoded.opCode);
+        for (int i = 0; i < instr.decoded.length - 1; i++) {
+            text += (i ? ", " : " ") + operand(instr.decoded, i);
+        }
+        return text;
+    }
+
+    // Listing with block and loop annotations, data cells eight to a line
+    void writeListing(std::ostream& out) const
+    {
+        for (const Region& region : regions())
+        {
+            if (!region.code)
+            {
+                for (long long address = region.begin; address < region.end; address += 8)
+                {
+                    out << pad(address) << "  .data";
+                    for (long long i = address; i < std::min(region.end, address + 8); i++) {
+                        out << (i == address ? " " : ", ") << _image[i];
+                    }
+                    out << "\n";
+                }
+                continue;
+            }
+
+            for (auto it = _blocks.lower_bound(region.begin); it != _blocks.end() && it->first < region.end; ++it)
+            {
+                const Block& block = it->second;
+                out << "\n" << label(block.begin) << ":";
+                if (_entries.count(block.begin)) out << "  ; entry";
+                if (isLoopHeader(block.begin)) out << "  ; loop header";
+                if (block.loopDepth > 0) out << "  ; loop depth " << block.loopDepth;
+                out << "\n";
+
+                for (long long address : block.instructions)
+                {
+                    const Instruction& instr = _instructions.at(address);
+                    std::string text = describe(instr);
+                    out << pad(address) << "  " << text;
+                    if (instr.writesCode) out << std::string(text.size() < 36 ? 36 - text.size() : 1, ' ') << "; writes code";
+                    out << "\n";
+                }
+                if (block.returnsTo >= 0) out << "        ; call, returns to " << label(block.returnsTo) << "\n";
+                if (block.indirect) out << "        ; -> indirect\n";
+                else if (block.fallsOff)
+                {
+                    out << "        ; -> runs into data at " << block.end;
+                    if (_codeWrites.count(block.end)) out << ", written by the program";
+                    out << "\n";
+                }
+            }
+        }
+    }
+
+    // Graphviz digraph, one box per block, solid edges for taken jumps and
+    // dashed ones for falling through, loop headers filled
+    void writeDot(std::ostream& out, const std::string& name = "intcode") const
+    {
+        out << "digraph " << name << " {\n";
+        out << "    node [shape=box fontname=\"monospace\"];\n";
+        bool indirect = false;
+        for (auto& entry : _blocks)
+        {
+            const Block& block = entry.second;
+            out << "    " << label(block.begin) << " [label=\"" << label(block.begin) << ":\\l";
+            for (long long address : block.instructions) {
+                out << address << ": " << describe(_instructions.at(address)) << "\\l";
+            }
+            out << "\"";
+            if (isLoopHeader(block.begin)) out << " style=filled fillcolor=lightgoldenrod";
+            if (_entries.count(block.begin)) out << " penwidth=2";
+            out << "];\n";
+
+            for (size_t i = 0; i < block.successors.size(); i++)
+            {
+                const long long target = block.successors[i];
+                out << "    " << label(block.begin) << " -> " << label(target);
+                if (target == block.returnsTo) out << " [style=dashed color=gray label=\"return\"]";
+                else if (isFallthrough(block, target)) out << " [style=dashed]";
+                out << ";\n";
+            }
+            if (block.indirect)
+            {
+                out << "    " << label(block.begin) << " -> indirect [style=dotted];\n";
+                indirect = true;
+            }
+        }
+        if (indirect) out << "    indirect [shape=ellipse label=\"?\"];\n";
+        out << "}\n";
+    }
+
+private:
+
+    void discover()
+    {
+        std::vector<long long> pending {0};
+        _entries.insert(0);
+        while (!pending.empty())
+        {
+            while (!pending.empty())
+            {
+                const long long entry = pending.back();
+                pending.pop_back();
+                trace(entry, pending);
+            }
+
+            // Constants the reached code computes or jumps through that look like code
+            for (long long candidate : _candidates)
+            {
+                if (!isCode(candidate) && decodesAt(candidate) && _entries.insert(candidate).second) {
+                    pending.push_back(candidate);
+                }
+            }
+        }
+    }
+
+    // Decodes straight-line code from address until control leaves it
+    void trace(long long address, std::vector<long long>& pending)
+    {
+        while (!_instructions.count(address) && decodesAt(address))
+        {
+            Instruction instr;
+            instr.address = address;
+            instr.word = _image[address];
+            instr.decoded = decode(address);
+            const DecodedInstruction& decoded = instr.decoded;
+            for (int i = 0; i < decoded.length; i++) {
+                _code[address + i] = 1;
+            }
+            _instructions[address] = instr;
+
+            if (decoded.opCode == ADD || decoded.opCode == MULT)
+            {
+                if (decoded.modes[0] == IMMEDIATE_MODE && decoded.modes[1] == IMMEDIATE_MODE)
+                {
+                    const long long a = decoded.operands[0], b = decoded.operands[1];
+                    _candidates.insert(decoded.opCode == ADD ? a + b : a * b);
+                }
+            }
+
+            if (decoded.opCode == HALT) {
+                return;
+            }
+            if (decoded.opCode == JUMP_IF_TRUE || decoded.opCode == JUMP_IF_FALSE)
+            {
+                if (mayTake(decoded))
+                {
+                    if (decoded.modes[1] == IMMEDIATE_MODE)
+                    {
+                        _targets.insert(decoded.operands[1]);
+                        pending.push_back(decoded.operands[1]);
+                    }
+                    else if (decoded.modes[1] == POSITION_MODE && inImage(decoded.operands[1])) {
+                        _candidates.insert(_image[decoded.operands[1]]);
+                    }
+                }
+                if (!mayFallThrough(decoded)) {
+                    return;
+                }
+            }
+            address += decoded.length;
+        }
+    }
+
+    bool inImage(long long address) const
+    {
+        return address >= 0 && address < (long long) _image.size();
+    }
+
+    // A whole instruction starts at address and none of its cells is already part of another
+    bool decodesAt(long long address) const
+    {
+        if (!inImage(address) || _code[address]) {
+            return false;
+        }
+        DecodedInstruction instr;
+        if (!decodeWord(_image[address], instr) || address + instr.length > (long long) _image.size()) {
+            return false;
+        }
+        for (int i = 1; i < instr.length; i++)
+        {
+            if (_code[address + i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    DecodedInstruction decode(long long address) const
+    {
+        DecodedInstruction instr;
+        decodeWord(_image[address], instr);
+        for (int i = 0; i < instr.length - 1; i++) {
+            instr.operands[i] = _image[address + 1 + i];
+        }
+        return instr;
+    }
+
+    // Jumps on an immediate condition always or never go
+    static bool mayTake(const DecodedInstruction& instr)
+    {
+        if (instr.modes[0] != IMMEDIATE_MODE) {
+            return true;
+        }
+        return (instr.operands[0] != 0) == (instr.opCode == JUMP_IF_TRUE);
+    }
+
+    static bool mayFallThrough(const DecodedInstruction& instr)
+    {
+        if (instr.modes[0] != IMMEDIATE_MODE) {
+            return true;
+        }
+        return (instr.operands[0] != 0) != (instr.opCode == JUMP_IF_TRUE);
+    }
+
+    static bool isJump(const DecodedInstruction& instr)
+    {
+        return instr.opCode == JUMP_IF_TRUE || instr.opCode == JUMP_IF_FALSE;
+    }
+
+    void buildBlocks()
+    {
+        std::set<long long> leaders(_entries);
+        leaders.insert(_targets.begin(), _targets.end());
+        for (auto& entry : _instructions)
+        {
+            const DecodedInstruction& decoded = entry.second.decoded;
+            if (isJump(decoded) || decoded.opCode == HALT) {
+                leaders.insert(entry.first + decoded.length);
+            }
+        }
+
+        Block* block = nullptr;
+        for (auto& entry : _instructions)
+        {
+            const long long address = entry.first;
+            if (block == nullptr || block->end != address || leaders.count(address))
+            {
+                block = &_blocks[address];
+                block->begin = address;
+            }
+            block->instructions.push_back(address);
+            block->end = address + entry.second.decoded.length;
+
+            const DecodedInstruction& decoded = entry.second.decoded;
+            if (isJump(decoded) || decoded.opCode == HALT) {
+                block = nullptr;
+            }
+        }
+
+        for (auto& entry : _blocks)
+        {
+            Block& block = entry.second;
+            const DecodedInstruction& last = _instructions.at(block.instructions.back()).decoded;
+            if (last.opCode == HALT) {
+                block.halts = true;
+            }
+            else if (isJump(last))
+            {
+                if (mayTake(last))
+                {
+                    if (last.modes[1] == IMMEDIATE_MODE)
+                    {
+                        if (_blocks.count(last.operands[1])) block.successors.push_back(last.operands[1]);
+                        else block.fallsOff = true;
+                    }
+                    else {
+                        block.indirect = true;
+                    }
+                }
+                if (mayFallThrough(last)) {
+                    addFallthrough(block);
+                }
+                addReturn(block);
+            }
+            else {
+                addFallthrough(block);
+            }
+        }
+
+        for (auto& entry : _blocks)
+        {
+            for (long long successor : entry.second.successors) {
+                _blocks[successor].predecessors.push_back(entry.first);
+            }
+        }
+
+        // Stores to fixed addresses inside the code or where it runs off into cells
+        // that do not decode yet, the program modifies itself
+        std::set<long long> unfinished;
+        for (auto& entry : _blocks)
+        {
+            if (entry.second.fallsOff) unfinished.insert(entry.second.end);
+        }
+        for (auto& entry : _instructions)
+        {
+            const DecodedInstruction& decoded = entry.second.decoded;
+            const int target = decoded.opCode == INPUT ? 0 : 2;
+            if ((decoded.opCode == INPUT || decoded.length == 4) && decoded.modes[target] == POSITION_MODE)
+            {
+                const long long address = decoded.operands[target];
+                if (isCode(address) || unfinished.count(address))
+                {
+                    entry.second.writesCode = true;
+                    _codeWrites.insert(address);
+                }
+            }
+        }
+    }
+
+    void addFallthrough(Block& block)
+    {
+        if (!_blocks.count(block.end)) {
+            block.fallsOff = true;
+        }
+        else if (std::find(block.successors.begin(), block.successors.end(), block.end) == block.successors.end()) {
+            block.successors.push_back(block.end);
+        }
+    }
+
+    void addReturn(Block& block)
+    {
+        for (long long address : block.instructions)
+        {
+            const DecodedInstruction& decoded = _instructions.at(address).decoded;
+            if ((decoded.opCode != ADD && decoded.opCode != MULT) ||
+                decoded.modes[0] != IMMEDIATE_MODE || decoded.modes[1] != IMMEDIATE_MODE) {
+                continue;
+            }
+            const long long a = decoded.operands[0], b = decoded.operands[1];
+            const long long pushed = decoded.opCode == ADD ? a + b : a * b;
+            if (pushed != block.begin && _entries.count(pushed) && _blocks.count(pushed) &&
+                std::find(block.successors.begin(), block.successors.end(), pushed) == block.successors.end())
+            {
+                block.returnsTo = pushed;
+                block.successors.push_back(pushed);
+            }
+        }
+    }
+
+    bool isFallthrough(const Block& block, long long target) const
+    {
+        if (target != block.end) {
+            return false;
+        }
+        // A jump to the next instruction counts as taken when it can only be taken
+        const DecodedInstruction& last = _instructions.at(block.instructions.back()).decoded;
+        return !isJump(last) || mayFallThrough(last);
+    }
+
+    // Back edges found depth first from the entries, each with the blocks
+    // that reach its source without going through the header
+    void findLoops()
+    {
+        std::map<long long, int> state;     // 1 on the stack, 2 done
+        std::map<long long, std::set<long long>> bodies;
+        for (long long entry : _entries)
+        {
+            if (!_blocks.count(entry) || state[entry]) {
+                continue;
+            }
+            std::vector< std::pair<long long, size_t> > stack { {entry, 0} };
+            state[entry] = 1;
+            while (!stack.empty())
+            {
+                const long long current = stack.back().first;
+                const Block& block = _blocks.at(current);
+                if (stack.back().second == block.successors.size())
+                {
+                    state[current] = 2;
+                    stack.pop_back();
+                    continue;
+                }
+                const long long next = block.successors[stack.back().second++];
+                if (state[next] == 1) {
+                    collectBody(next, current, bodies[next]);
+                }
+                else if (state[next] == 0)
+                {
+                    state[next] = 1;
+                    stack.push_back({next, 0});
+                }
+            }
+        }
+
+        for (auto& body : bodies)
+        {
+            Loop loop;
+            loop.header = body.first;
+            loop.blocks = body.second;
+            _loops.push_back(loop);
+            for (long long address : loop.blocks) {
+                _blocks[address].loopDepth++;
+            }
+        }
+    }
+
+    void collectBody(long long header, long long tail, std::set<long long>& body)
+    {
+        body.insert(header);
+        std::vector<long long> work;
+        if (body.insert(tail).second) {
+            work.push_back(tail);
+        }
+        while (!work.empty())
+        {
+            const long long address = work.back();
+            work.pop_back();
+            for (long long predecessor : _blocks.at(address).predecessors)
+            {
+                if (body.insert(predecessor).second) {
+                    work.push_back(predecessor);
+                }
+            }
+        }
+    }
+
+    bool isLoopHeader(long long address) const
+    {
+        for (const Loop& loop : _loops)
+        {
+            if (loop.header == address) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static std::string name(int opCode)
+    {
+        static const char* const names[] = {
+            "INVALID", "ADD", "MULT", "INPUT", "OUTPUT", "JUMP_IF_TRUE", "JUMP_IF_FALSE", "LESS_THAN", "EQUALS", "BASE_OP"
+        };
+        if (opCode == HALT) {
+            return "HALT";
+        }
+        return names[opCode > 0 && opCode < 10 ? opCode : 0];
+    }
+
+    std::string operand(const DecodedInstruction& instr, int i) const
+    {
+        const long long value = instr.operands[i];
+        switch (instr.modes[i])
+        {
+            case POSITION_MODE:
+                return "[" + std::to_string(value) + "]";
+
+            case IMMEDIATE_MODE:
+                if (i == 1 && isJump(instr) && _blocks.count(value)) {
+                    return label(value);
+                }
+                return std::to_string(value);
+
+            default:
+                return value < 0 ? "[rb" + std::to_string(value) + "]" : "[rb+" + std::to_string(value) + "]";
+        };
+    }
+
+    static std::string label(long long address)
+    {
+        return "L" + std::to_string(address);
+    }
+
+    static std::string pad(long long address)
+    {
+        std::string text = std::to_string(address);
+        return std::string(text.size() < 6 ? 6 - text.size() : 0, ' ') + text;
+    }
+
+    std::vector<long long> _image;
+    std::vector<unsigned char> _code;
+    std::map<long long, Instruction> _instructions;
+    std::map<long long, Block> _blocks;
+    std::vector<Loop> _loops;
+    std::set<long long> _entries;
+    std::set<long long> _targets;
+    std::set<long long> _codeWrites;    // Fixed addresses of code cells the program stores to
+    std::set<long long> _candidates;    // Possible entry points not reached by a direct jump
+};
+
+#endif /* INTCODE_DISASSEMBLER_HPP */
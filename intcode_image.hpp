@@ -0,0 +1,476 @@
+#ifndef INTCODE_IMAGE_HPP
+#define INTCODE_IMAGE_HPP
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <filesystem>
+#include "intcode_instruction_set.hpp"
+#include "intcode_disassembler.hpp"
+#include "intcode_loader.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define INTCODE_IMAGE_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Intcode program in a binary image that loads without parsing.
+//
+// File layout, every field little endian:
+//   header      "ICIM", u32 version, u64 cell count, u64 hash of the text the
+//               image was built from, u64 checksum of the cells, u64 offset
+//               and entry count of the decode section, u64 offset and length
+//               in words of the CFG section (offsets 0 when left out)
+//   cells       one i64 per cell, right after the 64 byte header
+//   decode      per instruction found statically: i64 address, u8 opcode,
+//               length and the three parameter modes, 3 bytes padding
+//   CFG         i64 words: block count, then per block begin, end, flags
+//               (1 indirect, 2 halts) and its successor count and addresses
+//
+// On POSIX systems the file is mapped and cells() points into the mapping.
+// load() keeps images of text programs in a cache directory, keyed by the
+// hash of the text, so only the first load of a program parses it.
+class IntcodeImage : private IntcodeInstructionSet
+{
+public:
+
+    static const uint32_t VERSION = 1;
+    static const size_t HEADER_SIZE = 64;
+
+    struct DecodeEntry
+    {
+        long long address = 0;
+        unsigned char opCode = 0;
+        unsigned char length = 0;
+        unsigned char modes[3] = {0, 0, 0};
+    };
+
+    struct Block
+    {
+        long long begin = 0;
+        long long end = 0;
+        bool indirect = false;
+        bool halts = false;
+        std::vector<long long> successors;
+    };
+
+    IntcodeImage() = default;
+    IntcodeImage(IntcodeImage&& other) noexcept { *this = std::move(other); }
+
+    IntcodeImage& operator=(IntcodeImage&& other) noexcept
+    {
+        if (this != &other)
+        {
+            // Moved vectors keep their storage, the pointers into it stay valid
+            unmap();
+            _owned = std::move(other._owned);
+            _buffer = std::move(other._buffer);
+            _file = other._file;
+            _fileSize = other._fileSize;
+            _mapped = other._mapped;
+            _cells = other._cells;
+            _size = other._size;
+            _sourceHash = other._sourceHash;
+            _fromCache = other._fromCache;
+            other._file = nullptr;
+            other._mapped = false;
+            other._cells = nullptr;
+            other._size = 0;
+        }
+        return *this;
+    }
+
+    IntcodeImage(const IntcodeImage&) = delete;
+    IntcodeImage& operator=(const IntcodeImage&) = delete;
+    ~IntcodeImage() { unmap(); }
+
+    // Comma separated text, parsed every time
+    static IntcodeImage parse(const std::string& textFile)
+    {
+        std::string text = readText(textFile);
+        IntcodeImage image;
+        image._sourceHash = hashText(text);
+        image.adopt(parseText(text));
+        return image;
+    }
+
+    // Binary image, mapped where possible. Throws on a bad header, section or checksum.
+    static IntcodeImage open(const std::string& imageFile)
+    {
+        IntcodeImage image;
+#if defined(INTCODE_IMAGE_MMAP)
+        const int fd = ::open(imageFile.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Unable to open image " + imageFile);
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0 || status.st_size < (off_t) HEADER_SIZE)
+        {
+            ::close(fd);
+            throw std::runtime_error("Image " + imageFile + " is truncated");
+        }
+        void* file = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (file == MAP_FAILED) {
+            throw std::runtime_error("Unable to map image " + imageFile);
+        }
+        image._file = static_cast<const unsigned char*>(file);
+        image._fileSize = status.st_size;
+        image._mapped = true;
+#else
+        std::ifstream in(imageFile, std::ios::binary);
+        image._buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        image._file = reinterpret_cast<const unsigned char*>(image._buffer.data());
+        image._fileSize = image._buffer.size();
+#endif
+        image.validate(imageFile);
+        return image;
+    }
+
+    // Text program through the cache: the image of the same text if there is
+    // one, otherwise parses and stores the image for the next load. An
+    // unusable cache falls back to parsing.
+    static IntcodeImage load(const std::string& textFile, const std::string& cacheDirectory = defaultCacheDirectory())
+    {
+        std::string text = readText(textFile);
+        const unsigned long long hash = hashText(text);
+        const std::string cached = cachePath(cacheDirectory, hash);
+        try
+        {
+            IntcodeImage image = open(cached);
+            if (image._sourceHash == hash)
+            {
+                image._fromCache = true;
+                return image;
+            }
+        }
+        catch (const std::runtime_error&) { }
+
+        IntcodeImage image;
+        image._sourceHash = hash;
+        image.adopt(parseText(text));
+        try
+        {
+            std::filesystem::create_directories(cacheDirectory);
+            write(cached, image.toVector(), hash);
+        }
+        catch (const std::exception&) { }
+        return image;
+    }
+
+    // $INTCODE_CACHE_DIR, or .intcode_cache in the working directory
+    static std::string defaultCacheDirectory()
+    {
+        const char* directory = std::getenv("INTCODE_CACHE_DIR");
+        return directory != nullptr && *directory ? directory : ".intcode_cache";
+    }
+
+    // Writes the image with the decode and CFG sections of IntcodeDisassembler
+    // unless analysis is false. Goes through a temporary file so a reader
+    // never sees half of it.
+    static void write(const std::string& imageFile, const std::vector<long long>& cells,
+        unsigned long long sourceHash = 0, bool analysis = true)
+    {
+        std::vector<unsigned char> data(HEADER_SIZE);
+        std::memcpy(data.data(), "ICIM", 4);
+        putWord(data, 4, VERSION, 4);
+        putWord(data, 8, cells.size(), 8);
+        putWord(data, 16, sourceHash, 8);
+        putWord(data, 24, checksum(cells.data(), cells.size()), 8);
+        for (long long cell : cells) {
+            appendWord(data, cell);
+        }
+
+        if (analysis)
+        {
+            IntcodeDisassembler program(cells);
+            putWord(data, 32, data.size(), 8);
+            putWord(data, 40, program.instructions().size(), 8);
+            for (auto& entry : program.instructions())
+            {
+                const DecodedInstruction& decoded = entry.second.decoded;
+                appendWord(data, entry.first);
+                const unsigned char fields[8] = {decoded.opCode, decoded.length, decoded.modes[0], decoded.modes[1],
+                    decoded.modes[2], 0, 0, 0};
+                data.insert(data.end(), fields, fields + 8);
+            }
+
+            const size_t cfg = data.size();
+            appendWord(data, program.blocks().size());
+            for (auto& entry : program.blocks())
+            {
+                const IntcodeDisassembler::Block& block = entry.second;
+                appendWord(data, block.begin);
+                appendWord(data, block.end);
+                appendWord(data, (block.indirect ? 1 : 0) | (block.halts ? 2 : 0));
+                appendWord(data, block.successors.size());
+                for (long long successor : block.successors) {
+                    appendWord(data, successor);
+                }
+            }
+            putWord(data, 48, cfg, 8);
+            putWord(data, 56, (data.size() - cfg) / 8, 8);
+        }
+
+        const std::string temporary = imageFile + ".tmp" + std::to_string(writerId());
+        {
+            std::ofstream out(temporary, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(data.data()), data.size());
+            if (!out) {
+                throw std::runtime_error("Unable to write image " + imageFile);
+            }
+        }
+        if (std::rename(temporary.c_str(), imageFile.c_str()) != 0)
+        {
+            std::remove(temporary.c_str());
+            throw std::runtime_error("Unable to write image " + imageFile);
+        }
+    }
+
+    size_t size() const { return _size; }
+    const long long* cells() const { return _cells; }
+    long long operator[](size_t address) const { return _cells[address]; }
+    std::vector<long long> toVector() const { return std::vector<long long>(_cells, _cells + _size); }
+
+    unsigned long long sourceHash() const { return _sourceHash; }
+    bool fromCache() const { return _fromCache; }
+    bool isMapped() const { return _mapped; }
+
+    bool hasDecode() const { return _file != nullptr && word(32) != 0; }
+    bool hasCfg() const { return _file != nullptr && word(48) != 0; }
+
+    std::vector<DecodeEntry> decode() const
+    {
+        std::vector<DecodeEntry> entries(hasDecode() ? word(40) : 0);
+        size_t offset = hasDecode() ? word(32) : 0;
+        for (DecodeEntry& entry : entries)
+        {
+            entry.address = word(offset);
+            entry.opCode = _file[offset + 8];
+            entry.length = _file[offset + 9];
+            std::memcpy(entry.modes, _file + offset + 10, 3);
+            offset += 16;
+        }
+        return entries;
+    }
+
+    std::vector<Block> cfg() const
+    {
+        std::vector<Block> blocks;
+        if (!hasCfg()) {
+            return blocks;
+        }
+        size_t offset = word(48);
+        blocks.resize(word(offset));
+        offset += 8;
+        for (Block& block : blocks)
+        {
+            block.begin = word(offset);
+            block.end = word(offset + 8);
+            const unsigned long long flags = word(offset + 16);
+            block.indirect = flags & 1;
+            block.halts = flags & 2;
+            block.successors.resize(word(offset + 24));
+            offset += 32;
+            for (long long& successor : block.successors)
+            {
+                successor = word(offset);
+                offset += 8;
+            }
+        }
+        return blocks;
+    }
+
+    // FNV-1a over the text taken eight bytes at a time, the length mixed in last
+    static unsigned long long hashText(const std::string& text)
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        size_t i = 0;
+        for (; i + 8 <= text.size(); i += 8)
+        {
+            unsigned long long word;
+            std::memcpy(&word, text.data() + i, 8);
+            hash = (hash ^ word) * 1099511628211ULL;
+        }
+        for (; i < text.size(); i++) {
+            hash = (hash ^ (unsigned char) text[i]) * 1099511628211ULL;
+        }
+        return (hash ^ text.size()) * 1099511628211ULL;
+    }
+
+    // FNV-1a over whole cells, checked on every open
+    static unsigned long long checksum(const long long* cells, size_t count)
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < count; i++) {
+            hash = (hash ^ (unsigned long long) cells[i]) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+private:
+
+    static std::string readText(const std::string& textFile)
+    {
+        std::ifstream in(textFile, std::ios::binary | std::ios::ate);
+        if (!in) {
+            throw std::runtime_error("Unable to open " + textFile);
+        }
+        std::string text(in.tellg(), '\0');
+        in.seekg(0);
+        in.read(&text[0], text.size());
+        return text;
+    }
+
+    static std::vector<long long> parseText(const std::string& text)
+    {
+        return IntcodeLoader::parse(text.data(), text.data() + text.size());
+    }
+
+    // Tells concurrent writers of the same image apart
+    static unsigned long long writerId()
+    {
+#if defined(INTCODE_IMAGE_MMAP)
+        return (unsigned long long) getpid();
+#else
+        return (unsigned long long) std::rand();
+#endif
+    }
+
+    static std::string cachePath(const std::string& directory, unsigned long long hash)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.icim", hash);
+        return directory + "/" + name;
+    }
+
+    static void putWord(std::vector<unsigned char>& data, size_t offset, unsigned long long value, int bytes)
+    {
+        for (int i = 0; i < bytes; i++) {
+            data[offset + i] = (unsigned char) (value >> (8 * i));
+        }
+    }
+
+    static void appendWord(std::vector<unsigned char>& data, unsigned long long value)
+    {
+        data.resize(data.size() + 8);
+        putWord(data, data.size() - 8, value, 8);
+    }
+
+    unsigned long long word(size_t offset) const
+    {
+        unsigned long long value = 0;
+        for (int i = 0; i < 8; i++) {
+            value |= (unsigned long long) _file[offset + i] << (8 * i);
+        }
+        return value;
+    }
+
+    static bool littleEndian()
+    {
+        const uint16_t probe = 1;
+        return *reinterpret_cast<const unsigned char*>(&probe) == 1;
+    }
+
+    void adopt(std::vector<long long> cells)
+    {
+        _owned = std::move(cells);
+        _cells = _owned.data();
+        _size = _owned.size();
+    }
+
+    void validate(const std::string& imageFile)
+    {
+        if (_fileSize < HEADER_SIZE) {
+            throw std::runtime_error("Image " + imageFile + " is truncated");
+        }
+        if (std::memcmp(_file, "ICIM", 4) != 0 || (word(4) & 0xffffffff) != VERSION) {
+            throw std::runtime_error(imageFile + " is not an Intcode image of version " + std::to_string(VERSION));
+        }
+        _size = word(8);
+        _sourceHash = word(16);
+        // Counts are compared with the bytes left, sums of them could overflow
+        if (_size > (_fileSize - HEADER_SIZE) / 8 || word(32) > _fileSize || word(48) > _fileSize ||
+            word(40) > (_fileSize - word(32)) / 16 || word(56) > (_fileSize - word(48)) / 8) {
+            throw std::runtime_error("Image " + imageFile + " is truncated");
+        }
+        if (hasCfg() && !validCfg()) {
+            throw std::runtime_error("Image " + imageFile + " has a corrupt CFG section");
+        }
+
+        // Cells are used in place when the layout matches the machine's
+        if (littleEndian() && reinterpret_cast<uintptr_t>(_file + HEADER_SIZE) % alignof(long long) == 0) {
+            _cells = reinterpret_cast<const long long*>(_file + HEADER_SIZE);
+        }
+        else
+        {
+            _owned.resize(_size);
+            for (size_t i = 0; i < _size; i++) {
+                _owned[i] = (long long) word(HEADER_SIZE + 8 * i);
+            }
+            _cells = _owned.data();
+        }
+        if (checksum(_cells, _size) != word(24)) {
+            throw std::runtime_error("Image " + imageFile + " fails its checksum");
+        }
+    }
+
+    // Every block and successor count fits the words left in the section, so
+    // cfg() reads and allocates no more than the section holds
+    bool validCfg() const
+    {
+        const size_t end = word(48) + 8 * word(56);
+        size_t offset = word(48);
+        if (end - offset < 8) {
+            return false;
+        }
+        unsigned long long blocks = word(offset);
+        offset += 8;
+        for (; blocks > 0; blocks--)
+        {
+            if ((end - offset) / 8 < 4) {
+                return false;
+            }
+            const unsigned long long successors = word(offset + 24);
+            offset += 32;
+            if (successors > (end - offset) / 8) {
+                return false;
+            }
+            offset += 8 * successors;
+        }
+        return true;
+    }
+
+    void unmap()
+    {
+#if defined(INTCODE_IMAGE_MMAP)
+        if (_mapped) {
+            munmap(const_cast<unsigned char*>(_file), _fileSize);
+        }
+#endif
+        _mapped = false;
+        _file = nullptr;
+    }
+
+    std::vector<long long> _owned;          // Cells when they are not used from the file
+    std::vector<char> _buffer;              // File contents where it is not mapped
+    const unsigned char* _file = nullptr;
+    size_t _fileSize = 0;
+    bool _mapped = false;
+    const long long* _cells = nullptr;
+    size_t _size = 0;
+    unsigned long long _sourceHash = 0;
+    bool _fromCache = false;
+};
+
+#endif /* INTCODE_IMAGE_HPP */
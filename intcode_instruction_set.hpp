@@ -0,0 +1,98 @@
+#ifndef INTCODE_INSTRUCTION_SET_HPP
+#define INTCODE_INSTRUCTION_SET_HPP
+
+// Opcodes, parameter modes and the decoded instruction layout shared by
+// IntcodeComputer and its execution backends.
+struct IntcodeInstructionSet
+{
+
+enum Opcode
+{
+    HALT            = 99,
+    ADD             = 1,
+    MULT            = 2,
+    INPUT           = 3,
+    OUTPUT          = 4,
+    JUMP_IF_TRUE    = 5,
+    JUMP_IF_FALSE   = 6,
+    LESS_THAN       = 7,
+    EQUALS          = 8,
+    BASE_OP         = 9
+};
+
+enum ParameterMode
+{
+    POSITION_MODE   = 0,
+    IMMEDIATE_MODE  = 1,
+    RELATIVE_MODE   = 2
+};
+
+// Handlers beyond the plain opcodes (1-9) used by the decoded instruction loops
+enum Handler
+{
+    HANDLER_HALT            = 10,
+    HANDLER_COMPARE_JUMP    = 11,   // LESS_THAN/EQUALS + JUMP_IF_TRUE/JUMP_IF_FALSE on the result
+    HANDLER_ADD_COMPARE     = 12    // ADD + LESS_THAN/EQUALS reading the sum
+};
+
+// Longest span of cells a fused instruction pair is decoded from
+static const int MAX_FUSED_LENGTH = 8;
+
+// Instruction with its parameter modes split out and operand cells copied,
+// so the hot loop does not divide the raw word on every step.
+template <typename Cell>
+struct BasicDecodedInstruction
+{
+    unsigned char opCode = 0;   // 0 marks a cell that is not decoded (yet)
+    unsigned char handler = 0;  // Dense opcode index used by the threaded dispatch table
+    unsigned char length = 0;
+    unsigned char fusedLength = 0;  // Cells covered together with the fused successor, 0 if not fused
+    unsigned char modes[3] = {0, 0, 0};
+    Cell operands[3] = {0, 0, 0};
+};
+
+typedef BasicDecodedInstruction<long long> DecodedInstruction;
+
+    // Number of cells taken by the instruction, 0 for an unknown opcode
+    static constexpr int instructionLength(int opCode)
+    {
+        switch (opCode)
+        {
+            case ADD: case MULT: case LESS_THAN: case EQUALS:
+                return 4;
+
+            case JUMP_IF_TRUE: case JUMP_IF_FALSE:
+                return 3;
+
+            case INPUT: case OUTPUT: case BASE_OP:
+                return 2;
+
+            case HALT:
+                return 1;
+
+            default:
+                return 0;
+        };
+    }
+
+    // Splits the raw word into opcode and modes, operands are left to the caller
+    template <typename Cell>
+    static constexpr bool decodeWord(Cell word, BasicDecodedInstruction<Cell>& instr)
+    {
+        int opCode = word % 100;
+        instr.length = instructionLength(opCode);
+        if (instr.length == 0) {
+            return false;
+        }
+
+        instr.modes[0] = (word % 1000) / 100;
+        instr.modes[1] = (word % 10000) / 1000;
+        instr.modes[2] = word / 10000;
+        instr.handler = opCode == HALT ? HANDLER_HALT : opCode;
+        instr.fusedLength = 0;
+        instr.opCode = opCode;
+        return true;
+    }
+};
+
+#endif /* INTCODE_INSTRUCTION_SET_HPP */
@@ -0,0 +1,775 @@
+#ifndef INTCODE_JIT_HPP
+#define INTCODE_JIT_HPP
+
+#if defined(__x86_64__) && defined(__linux__)
+#define INTCODE_JIT_AVAILABLE 1
+
+#include <sys/mman.h>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include "intcode_instruction_set.hpp"
+
+// Translates basic blocks of an Intcode image into x86-64 machine code.
+//
+// Compiled code keeps the VM state pinned in callee saved registers:
+//   rbx - State*            r12 - memory base      r13 - memory size (cells)
+//   r14 - relative base     r15 - code bitmap      rbp - block table
+// Blocks contain ADD, MULT, LESS_THAN, EQUALS, BASE_OP and end with a jump.
+// INPUT, OUTPUT and HALT are left to the interpreter, as is every access
+// outside of the current memory size, so blocks do not depend on it. Stores that land on a cell marked in the
+// caller's code bitmap (one bit per cell) leave the code so the caller can invalidate it.
+class IntcodeJit : private IntcodeInstructionSet
+{
+public:
+
+    // Exchanged with the compiled code, offsets are baked into the emitted code
+    struct State
+    {
+        long long* memory;
+        long long memorySize;
+        long long relativeBase;
+        const unsigned long long* codeBits;
+        void** blockTable;
+        long long instructionPointer;
+        long long writeAddress;
+        unsigned long long instructionCount;
+        unsigned long long instructionLimit;    // Blocks are not entered once the count reaches it
+    };
+
+    enum ExitReason
+    {
+        EXIT_INTERPRET  = 0,    // Interpreter has to execute the instruction at instructionPointer
+        EXIT_CODE_WRITE = 1,    // Store to writeAddress hit a compiled cell
+        EXIT_CHAIN_MISS = 2,    // Next block at instructionPointer is not compiled yet
+        EXIT_BUDGET     = 3     // Instruction limit reached before the block at instructionPointer
+    };
+
+    IntcodeJit() = default;
+
+    // Compiled code is tied to one VM, copies start out empty
+    IntcodeJit(const IntcodeJit&) { }
+    IntcodeJit& operator=(const IntcodeJit&)
+    {
+        flush();
+        return *this;
+    }
+
+    ~IntcodeJit()
+    {
+        if (_buffer != nullptr) {
+            munmap(_buffer, BUFFER_SIZE);
+        }
+    }
+
+    // Code pointer of the block starting at address, nullptr if it cannot be compiled.
+    // compiled is set when the block was compiled by this call. Blocks end
+    // before instructions covering a cell marked in hot (memorySize cells).
+    void* blockAt(long long address, const long long* memory, long long memorySize, bool* compiled = nullptr,
+        const unsigned char* hot = nullptr)
+    {
+        prepare(memorySize);
+        if (_status[address] == UNKNOWN)
+        {
+            compile(address, memory, memorySize, hot);
+            if (compiled != nullptr) *compiled = true;
+        }
+        return _blockTable[address];
+    }
+
+    // End of the cells the block at address was compiled from
+    long long blockEnd(long long address) { return _blockEnd[address]; }
+
+    // state.codeBits has to cover state.memorySize cells
+    ExitReason run(void* code, State& state)
+    {
+        typedef int (*EntryFunction)(State*, void*);
+        prepare(state.memorySize);
+        state.blockTable = _blockTable.data();
+        return static_cast<ExitReason>(reinterpret_cast<EntryFunction>(_buffer)(&state, code));
+    }
+
+    bool covers(long long index)
+    {
+        return index >= 0 && index < (long long) _codeMask.size() && _codeMask[index] != 0;
+    }
+
+    // Drops every block (or uncompilable marker) containing the cell, returns how many
+    size_t invalidate(long long index)
+    {
+        return removeBlocks([index](const Block& block) { return block.start <= index && index < block.end; },
+            // Code that keeps rewriting itself is cheaper to interpret than to recompile
+            [this](long long start) { return ++_invalidations[start] < MAX_INVALIDATIONS ? UNKNOWN : UNCOMPILABLE; });
+    }
+
+    // Keeps the blocks whose source cells are unchanged in the (reset) image.
+    // The others are moved out of place, unchanged blocks cost one comparison.
+    void revalidate(const long long* memory, long long memorySize)
+    {
+        removeBlocks([memory, memorySize](const Block& block)
+        {
+            return block.end > memorySize || !std::equal(block.source.begin(), block.source.end(), memory + block.start);
+        },
+        [](long long) { return UNKNOWN; });
+    }
+
+    void flush()
+    {
+        _blocks.clear();
+        std::fill(_codeMask.begin(), _codeMask.end(), 0);
+        std::fill(_blockTable.begin(), _blockTable.end(), nullptr);
+        std::fill(_status.begin(), _status.end(), UNKNOWN);
+        _used = _blocksStart;
+    }
+
+private:
+
+    enum BlockStatus
+    {
+        UNKNOWN,
+        COMPILED,
+        UNCOMPILABLE
+    };
+
+    enum Register
+    {
+        RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+        R12 = 12, R13 = 13, R14 = 14, R15 = 15
+    };
+
+    enum Condition
+    {
+        CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_L = 0xC
+    };
+
+    enum ExitKind
+    {
+        SIDE_EXIT,          // Resume in the interpreter at ip
+        CHAIN_EXIT,         // Resume at ip, which has no compiled block
+        CHAIN_EXIT_DYNAMIC, // Same, but ip is held in rcx
+        WRITE_EXIT,         // Store to a constant address hit code, resume at ip
+        WRITE_EXIT_DYNAMIC, // Same, written address is held in rdx
+        BUDGET_EXIT         // Instruction limit reached, resume at ip
+    };
+
+    struct Block
+    {
+        long long start, end;
+        void* code;
+        std::vector<long long> source;  // Cells the block was compiled from
+    };
+
+    struct PendingExit
+    {
+        size_t jumpOffset;
+        ExitKind kind;
+        long long ip;
+        long long writeAddress;
+        int uncounted;
+    };
+
+    static const size_t BUFFER_SIZE = 4 << 20;
+    static const int MAX_BLOCK_INSTRUCTIONS = 64;
+    static const int MAX_INSTRUCTION_BYTES = 256;
+    static const unsigned char MAX_INVALIDATIONS = 8;
+
+    void prepare(long long memorySize)
+    {
+        if (_buffer == nullptr) {
+            allocateBuffer();
+        }
+        if ((long long) _codeMask.size() < memorySize)
+        {
+            _codeMask.resize(memorySize, 0);
+            _blockTable.resize(memorySize, nullptr);
+            _blockEnd.resize(memorySize, 0);
+            _status.resize(memorySize, UNKNOWN);
+            _invalidations.resize(memorySize, 0);
+        }
+    }
+
+    void allocateBuffer()
+    {
+        void* buffer = mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer == MAP_FAILED) {
+            throw std::runtime_error("Unable to map JIT code buffer");
+        }
+        _buffer = static_cast<unsigned char*>(buffer);
+
+        // Entry: int entry(State* state, void* code)
+        _code.clear();
+        const int saved[] = {RBX, RBP, R12, R13, R14, R15};
+        for (int reg : saved) push(reg);
+        movRegReg(RBX, RDI);
+        load(R12, RBX, -1, offsetof(State, memory));
+        load(R13, RBX, -1, offsetof(State, memorySize));
+        load(R14, RBX, -1, offsetof(State, relativeBase));
+        load(R15, RBX, -1, offsetof(State, codeBits));
+        load(RBP, RBX, -1, offsetof(State, blockTable));
+        jmpReg(RSI);
+
+        // Exit: eax holds the exit reason, instruction pointer is already stored
+        _exitOffset = _code.size();
+        store(RBX, -1, offsetof(State, relativeBase), R14);
+        for (int i = 5; i >= 0; i--) pop(saved[i]);
+        byte(0xC3);
+
+        std::memcpy(_buffer, _code.data(), _code.size());
+        _blocksStart = _used = (_code.size() + 63) & ~size_t(63);
+        protect(0, BUFFER_SIZE, PROT_READ | PROT_EXEC);
+    }
+
+    // Changes protection of the pages holding buffer bytes [offset, offset + length)
+    void protect(size_t offset, size_t length, int flags)
+    {
+        const size_t pageSize = 4096;
+        size_t first = offset & ~(pageSize - 1),
+            last = (offset + length + pageSize - 1) & ~(pageSize - 1);
+        if (mprotect(_buffer + first, last - first, flags) != 0) {
+            throw std::runtime_error("Unable to change JIT code buffer protection");
+        }
+    }
+
+    bool fitsInt32(long long value)
+    {
+        return value >= INT32_MIN && value <= INT32_MAX;
+    }
+
+    bool validConstantAddress(long long address)
+    {
+        return address >= 0 && fitsInt32(address * 8);
+    }
+
+    bool compilable(const DecodedInstruction& instr)
+    {
+        if (instr.opCode == INPUT || instr.opCode == OUTPUT || instr.opCode == HALT) {
+            return false;
+        }
+
+        int params = instr.length - 1;
+        for (int i = 0; i < params; i++)
+        {
+            bool isDestination = i == 2;
+            switch (instr.modes[i])
+            {
+                case POSITION_MODE:
+                    if (!validConstantAddress(instr.operands[i])) return false;
+                    break;
+
+                case IMMEDIATE_MODE:
+                    if (isDestination) return false;
+                    break;
+
+                case RELATIVE_MODE:
+                    if (!fitsInt32(instr.operands[i])) return false;
+                    break;
+
+                default:
+                    return false;
+            };
+        }
+        return true;
+    }
+
+    void compile(long long address, const long long* memory, long long memorySize, const unsigned char* hot)
+    {
+        std::vector<DecodedInstruction> instructions;
+        long long end = address;
+        while ((int) instructions.size() < MAX_BLOCK_INSTRUCTIONS)
+        {
+            DecodedInstruction instr;
+            if (end >= memorySize || !decodeWord(memory[end], instr) || end + instr.length > memorySize) {
+                break;
+            }
+            if (hot != nullptr && std::find(hot + end, hot + end + instr.length, 1) != hot + end + instr.length) {
+                break;
+            }
+            for (int i = 0; i < instr.length - 1; i++) {
+                instr.operands[i] = memory[end + 1 + i];
+            }
+            if (!compilable(instr)) {
+                break;
+            }
+
+            instructions.push_back(instr);
+            end += instr.length;
+            if (instr.opCode == JUMP_IF_TRUE || instr.opCode == JUMP_IF_FALSE) {
+                break;
+            }
+        }
+
+        if (instructions.empty())
+        {
+            DecodedInstruction instr;
+            long long length = decodeWord(memory[address], instr) ? instr.length : 1;
+            long long blockEnd = std::min(address + length, memorySize);
+            addBlock(Block {address, blockEnd, nullptr,
+                std::vector<long long>(memory + address, memory + blockEnd)});
+            _status[address] = UNCOMPILABLE;
+            return;
+        }
+
+        if (_used + instructions.size() * MAX_INSTRUCTION_BYTES > BUFFER_SIZE) {
+            flush();
+        }
+
+        emitBlock(address, instructions);
+        if (_used + _code.size() > BUFFER_SIZE)
+        {
+            // Exit stubs can take the block past the estimate, jumps are relative to _used
+            flush();
+            emitBlock(address, instructions);
+        }
+        protect(_used, _code.size(), PROT_READ | PROT_WRITE);
+        std::memcpy(_buffer + _used, _code.data(), _code.size());
+        protect(_used, _code.size(), PROT_READ | PROT_EXEC);
+
+        addBlock(Block {address, end, _buffer + _used,
+            std::vector<long long>(memory + address, memory + end)});
+        _blockTable[address] = _buffer + _used;
+        _status[address] = COMPILED;
+        _used = (_used + _code.size() + 15) & ~size_t(15);
+    }
+
+    template <typename Matches, typename NextStatus>
+    size_t removeBlocks(Matches matches, NextStatus nextStatus)
+    {
+        std::vector<Block> removed;
+        for (size_t i = 0; i < _blocks.size(); )
+        {
+            if (matches(_blocks[i]))
+            {
+                _blockTable[_blocks[i].start] = nullptr;
+                _status[_blocks[i].start] = nextStatus(_blocks[i].start);
+                removed.push_back(std::move(_blocks[i]));
+                _blocks[i] = std::move(_blocks.back());
+                _blocks.pop_back();
+            }
+            else {
+                i++;
+            }
+        }
+
+        for (auto& block : removed) {
+            std::fill(_codeMask.begin() + block.start, _codeMask.begin() + block.end, 0);
+        }
+
+        // Blocks may overlap, restore the cells still covered by survivors
+        for (auto& block : _blocks)
+        for (auto& gone : removed)
+        {
+            long long first = std::max(block.start, gone.start),
+                last = std::min(block.end, gone.end);
+            for (long long i = first; i < last; i++) {
+                _codeMask[i] = 1;
+            }
+        }
+        return removed.size();
+    }
+
+    void addBlock(const Block& block)
+    {
+        _blockEnd[block.start] = block.end;
+        for (long long i = block.start; i < block.end; i++) {
+            _codeMask[i] = 1;
+        }
+        _blocks.push_back(block);
+    }
+
+    void emitBlock(long long address, const std::vector<DecodedInstruction>& instructions)
+    {
+        _code.clear();
+        _exits.clear();
+        const int count = instructions.size();
+
+        // Chained blocks only come back to the caller through an exit, so the
+        // budget is checked on entry to every block
+        load(RAX, RBX, -1, offsetof(State, instructionCount));
+        cmpMem(RAX, RBX, offsetof(State, instructionLimit));
+        addExit(jcc(CC_AE), BUDGET_EXIT, address, 0, 0);
+        addMemImm(0, RBX, offsetof(State, instructionCount), count);
+
+        long long ip = address;
+        for (int k = 0; k < count; k++)
+        {
+            const DecodedInstruction& instr = instructions[k];
+            const long long nextIp = ip + instr.length;
+            switch (instr.opCode)
+            {
+                case ADD: case MULT: case LESS_THAN: case EQUALS:
+                {
+                    loadOperand(RAX, instr, 0, ip, count - k);
+                    loadOperand(RCX, instr, 1, ip, count - k);
+                    if (instr.modes[2] == RELATIVE_MODE) {
+                        relativeAddress(RDX, instr.operands[2], ip, count - k);
+                    }
+                    else {
+                        checkConstantAddress(instr.operands[2], ip, count - k);
+                    }
+
+                    if (instr.opCode == ADD) aluRegReg(0x01, RAX, RCX);
+                    else if (instr.opCode == MULT) imul(RAX, RCX);
+                    else
+                    {
+                        aluRegReg(0x39, RAX, RCX);
+                        setcc(instr.opCode == LESS_THAN ? CC_L : CC_E);
+                    }
+
+                    // Store, then leave if the cell is marked as code
+                    if (instr.modes[2] == RELATIVE_MODE)
+                    {
+                        store(R12, RDX, 0, RAX);
+                        testCodeBit(RDX);
+                        addExit(jcc(CC_B), WRITE_EXIT_DYNAMIC, nextIp, 0, count - k - 1);
+                    }
+                    else
+                    {
+                        long long target = instr.operands[2];
+                        store(R12, -1, target * 8, RAX);
+                        testByteImm(R15, target >> 3, 1 << (target & 7));
+                        addExit(jcc(CC_NE), WRITE_EXIT, nextIp, target, count - k - 1);
+                    }
+                    break;
+                }
+
+                case BASE_OP:
+                    loadOperand(RAX, instr, 0, ip, count - k);
+                    aluRegReg(0x01, R14, RAX);
+                    break;
+
+                case JUMP_IF_TRUE: case JUMP_IF_FALSE:
+                {
+                    loadOperand(RAX, instr, 0, ip, 1);
+                    loadOperand(RCX, instr, 1, ip, 1);
+                    aluRegReg(0x85, RAX, RAX);
+                    size_t notTaken = jcc(instr.opCode == JUMP_IF_TRUE ? CC_E : CC_NE);
+                    if (instr.modes[1] == IMMEDIATE_MODE) chainConstant(instr.operands[1]);
+                    else chainDynamic();
+                    patch(notTaken, _code.size());
+                    chainConstant(nextIp);
+                    break;
+                }
+            };
+            ip = nextIp;
+        }
+
+        const DecodedInstruction& last = instructions.back();
+        if (last.opCode != JUMP_IF_TRUE && last.opCode != JUMP_IF_FALSE) {
+            chainConstant(ip);
+        }
+        emitExits();
+    }
+
+    void loadOperand(int reg, const DecodedInstruction& instr, int i, long long ip, int uncounted)
+    {
+        switch (instr.modes[i])
+        {
+            case IMMEDIATE_MODE:
+                movImm(reg, instr.operands[i]);
+                break;
+
+            case POSITION_MODE:
+                checkConstantAddress(instr.operands[i], ip, uncounted);
+                load(reg, R12, -1, instr.operands[i] * 8);
+                break;
+
+            case RELATIVE_MODE:
+                relativeAddress(reg, instr.operands[i], ip, uncounted);
+                load(reg, R12, reg, 0);
+                break;
+        };
+    }
+
+    // Leaves to the interpreter while the cell is outside of memory
+    void checkConstantAddress(long long address, long long ip, int uncounted)
+    {
+        cmpImm(R13, address);
+        addExit(jcc(CC_BE), SIDE_EXIT, ip, 0, uncounted);
+    }
+
+    // reg = relative base + offset, leaves to the interpreter when outside of memory
+    void relativeAddress(int reg, long long offset, long long ip, int uncounted)
+    {
+        lea(reg, R14, offset);
+        aluRegReg(0x39, reg, R13);
+        addExit(jcc(CC_AE), SIDE_EXIT, ip, 0, uncounted);
+    }
+
+    void chainConstant(long long target)
+    {
+        if (validConstantAddress(target))
+        {
+            cmpImm(R13, target);
+            addExit(jcc(CC_BE), CHAIN_EXIT, target, 0, 0);
+            load(RAX, RBP, -1, target * 8);
+            aluRegReg(0x85, RAX, RAX);
+            addExit(jcc(CC_E), CHAIN_EXIT, target, 0, 0);
+            jmpReg(RAX);
+        }
+        else {
+            addExit(jmp(), CHAIN_EXIT, target, 0, 0);
+        }
+    }
+
+    void chainDynamic()
+    {
+        aluRegReg(0x39, RCX, R13);
+        addExit(jcc(CC_AE), CHAIN_EXIT_DYNAMIC, 0, 0, 0);
+        load(RAX, RBP, RCX, 0);
+        aluRegReg(0x85, RAX, RAX);
+        addExit(jcc(CC_E), CHAIN_EXIT_DYNAMIC, 0, 0, 0);
+        jmpReg(RAX);
+    }
+
+    void addExit(size_t jumpOffset, ExitKind kind, long long ip, long long writeAddress, int uncounted)
+    {
+        _exits.push_back(PendingExit {jumpOffset, kind, ip, writeAddress, uncounted});
+    }
+
+    void emitExits()
+    {
+        for (auto& exit : _exits)
+        {
+            patch(exit.jumpOffset, _code.size());
+            if (exit.kind == CHAIN_EXIT_DYNAMIC) {
+                store(RBX, -1, offsetof(State, instructionPointer), RCX);
+            }
+            else {
+                storeImm(RBX, offsetof(State, instructionPointer), exit.ip);
+            }
+
+            if (exit.kind == WRITE_EXIT) {
+                storeImm(RBX, offsetof(State, writeAddress), exit.writeAddress);
+            }
+            else if (exit.kind == WRITE_EXIT_DYNAMIC) {
+                store(RBX, -1, offsetof(State, writeAddress), RDX);
+            }
+
+            if (exit.uncounted > 0) {
+                addMemImm(5, RBX, offsetof(State, instructionCount), exit.uncounted);
+            }
+
+            int reason = EXIT_INTERPRET;
+            if (exit.kind == WRITE_EXIT || exit.kind == WRITE_EXIT_DYNAMIC) reason = EXIT_CODE_WRITE;
+            if (exit.kind == CHAIN_EXIT || exit.kind == CHAIN_EXIT_DYNAMIC) reason = EXIT_CHAIN_MISS;
+            if (exit.kind == BUDGET_EXIT) reason = EXIT_BUDGET;
+            byte(0xB8);
+            dword(reason);
+            size_t jump = jmp();
+            rel32(jump, _exitOffset);
+        }
+    }
+
+    // Machine code emission
+
+    void byte(int value) { _code.push_back(value & 0xFF); }
+
+    void dword(int32_t value)
+    {
+        for (int i = 0; i < 4; i++) byte(value >> (8 * i));
+    }
+
+    void qword(int64_t value)
+    {
+        for (int i = 0; i < 8; i++) byte(value >> (8 * i));
+    }
+
+    void rex(bool wide, int reg, int index, int base, bool force = false)
+    {
+        int value = 0x40 | (wide ? 8 : 0) | ((reg >> 3) << 2) |
+            ((index >= 0 ? index >> 3 : 0) << 1) | (base >> 3);
+        if (value != 0x40 || force) byte(value);
+    }
+
+    // [base + index * scale + disp32], index < 0 means no index
+    void memoryOperand(int reg, int base, int index, int64_t disp, int scale = 3)
+    {
+        if (index < 0 && (base & 7) != RSP) {
+            byte(0x80 | ((reg & 7) << 3) | (base & 7));
+        }
+        else
+        {
+            byte(0x80 | ((reg & 7) << 3) | RSP);
+            byte((index < 0 ? 0 : scale << 6) | ((index < 0 ? RSP : index & 7) << 3) | (base & 7));
+        }
+        dword(disp);
+    }
+
+    void push(int reg) { rex(false, 0, -1, reg); byte(0x50 | (reg & 7)); }
+    void pop(int reg) { rex(false, 0, -1, reg); byte(0x58 | (reg & 7)); }
+
+    void movRegReg(int dst, int src)
+    {
+        rex(true, src, -1, dst);
+        byte(0x89);
+        byte(0xC0 | ((src & 7) << 3) | (dst & 7));
+    }
+
+    void movImm(int reg, int64_t value)
+    {
+        if (fitsInt32(value))
+        {
+            rex(true, 0, -1, reg);
+            byte(0xC7);
+            byte(0xC0 | (reg & 7));
+            dword(value);
+        }
+        else
+        {
+            rex(true, 0, -1, reg);
+            byte(0xB8 | (reg & 7));
+            qword(value);
+        }
+    }
+
+    void load(int dst, int base, int index, int64_t disp)
+    {
+        rex(true, dst, index, base);
+        byte(0x8B);
+        memoryOperand(dst, base, index, disp);
+    }
+
+    void store(int base, int index, int64_t disp, int src)
+    {
+        rex(true, src, index, base);
+        byte(0x89);
+        memoryOperand(src, base, index, disp);
+    }
+
+    void storeImm(int base, int64_t disp, int64_t value)
+    {
+        rex(true, 0, -1, base);
+        byte(0xC7);
+        memoryOperand(0, base, -1, disp);
+        dword(value);
+    }
+
+    // add (ext 0) or sub (ext 5) qword [base + disp], imm32
+    void addMemImm(int ext, int base, int64_t disp, int32_t value)
+    {
+        rex(true, 0, -1, base);
+        byte(0x81);
+        memoryOperand(ext, base, -1, disp);
+        dword(value);
+    }
+
+    // test byte [base + disp], mask
+    void testByteImm(int base, int64_t disp, int mask)
+    {
+        rex(false, 0, -1, base);
+        byte(0xF6);
+        memoryOperand(0, base, -1, disp);
+        byte(mask);
+    }
+
+    // Carry = bit address of the code bitmap, clobbers rcx
+    void testCodeBit(int address)
+    {
+        movRegReg(RCX, address);
+        rex(true, 0, -1, RCX);
+        byte(0xC1); byte(0xE8 | RCX); byte(6);  // shr rcx, 6
+        load(RCX, R15, RCX, 0);
+        rex(true, address, -1, RCX);
+        byte(0x0F); byte(0xA3);                 // bt rcx, address
+        byte(0xC0 | ((address & 7) << 3) | RCX);
+    }
+
+    void cmpImm(int reg, int32_t value)
+    {
+        rex(true, 0, -1, reg);
+        byte(0x81);
+        byte(0xF8 | (reg & 7));
+        dword(value);
+    }
+
+    // cmp reg, qword [base + disp]
+    void cmpMem(int reg, int base, int64_t disp)
+    {
+        rex(true, reg, -1, base);
+        byte(0x3B);
+        memoryOperand(reg, base, -1, disp);
+    }
+
+    void lea(int dst, int base, int64_t disp)
+    {
+        rex(true, dst, -1, base);
+        byte(0x8D);
+        memoryOperand(dst, base, -1, disp);
+    }
+
+    // op r/m64, r64 with both operands in registers (add 0x01, cmp 0x39, test 0x85)
+    void aluRegReg(int opcode, int dst, int src)
+    {
+        rex(true, src, -1, dst);
+        byte(opcode);
+        byte(0xC0 | ((src & 7) << 3) | (dst & 7));
+    }
+
+    void imul(int dst, int src)
+    {
+        rex(true, dst, -1, src);
+        byte(0x0F); byte(0xAF);
+        byte(0xC0 | ((dst & 7) << 3) | (src & 7));
+    }
+
+    // rax = condition ? 1 : 0
+    void setcc(int condition)
+    {
+        byte(0x0F); byte(0x90 | condition); byte(0xC0);
+        byte(0x0F); byte(0xB6); byte(0xC0);
+    }
+
+    size_t jcc(int condition)
+    {
+        byte(0x0F); byte(0x80 | condition);
+        dword(0);
+        return _code.size() - 4;
+    }
+
+    size_t jmp()
+    {
+        byte(0xE9);
+        dword(0);
+        return _code.size() - 4;
+    }
+
+    void jmpReg(int reg)
+    {
+        rex(false, 0, -1, reg);
+        byte(0xFF);
+        byte(0xE0 | (reg & 7));
+    }
+
+    // Jump inside the block being emitted
+    void patch(size_t jumpOffset, size_t target)
+    {
+        int32_t displacement = target - (jumpOffset + 4);
+        std::memcpy(&_code[jumpOffset], &displacement, 4);
+    }
+
+    // Jump from the block being emitted to an absolute buffer offset
+    void rel32(size_t jumpOffset, size_t bufferOffset)
+    {
+        int32_t displacement = (long long) bufferOffset - (long long) (_used + jumpOffset + 4);
+        std::memcpy(&_code[jumpOffset], &displacement, 4);
+    }
+
+    unsigned char* _buffer = nullptr;
+    size_t _used = 0, _blocksStart = 0, _exitOffset = 0;
+    std::vector<unsigned char> _code;
+    std::vector<PendingExit> _exits;
+    std::vector<Block> _blocks;
+    std::vector<unsigned char> _codeMask;
+    std::vector<void*> _blockTable;
+    std::vector<long long> _blockEnd;
+    std::vector<unsigned char> _status;
+    std::vector<unsigned char> _invalidations;
+};
+
+#endif /* __x86_64__ && __linux__ */
+
+#endif /* INTCODE_JIT_HPP */
@@ -0,0 +1,157 @@
+#ifndef INTCODE_LOADER_HPP
+#define INTCODE_LOADER_HPP
+
+#include <vector>
+#include <string>
+#include <istream>
+#include <fstream>
+#include <iterator>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define INTCODE_LOADER_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Reads the comma separated text of an Intcode program: the first line of
+// the file, numbers with an optional sign and whitespace around them. The
+// commas are counted first (16 bytes at a time with SSE2) so the cells are
+// converted by std::from_chars straight into a buffer of the right size.
+struct IntcodeLoader
+{
+    // Mapped where possible
+    static std::vector<long long> loadFile(const std::string& fileName)
+    {
+#if defined(INTCODE_LOADER_MMAP)
+        const int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Unable to open " + fileName);
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Unable to read " + fileName);
+        }
+        if (status.st_size == 0)
+        {
+            ::close(fd);
+            return std::vector<long long>();
+        }
+        void* file = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (file == MAP_FAILED) {
+            throw std::runtime_error("Unable to map " + fileName);
+        }
+        const char* text = static_cast<const char*>(file);
+        try
+        {
+            std::vector<long long> intCode = parse(text, text + status.st_size);
+            munmap(file, status.st_size);
+            return intCode;
+        }
+        catch (...)
+        {
+            munmap(file, status.st_size);
+            throw;
+        }
+#else
+        std::ifstream in(fileName, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("Unable to open " + fileName);
+        }
+        return load(in);
+#endif
+    }
+
+    // The rest of the stream
+    static std::vector<long long> load(std::istream& in)
+    {
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return parse(text.data(), text.data() + text.size());
+    }
+
+    static std::vector<long long> parse(const char* begin, const char* end)
+    {
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        if (newline != nullptr) {
+            end = newline;
+        }
+
+        std::vector<long long> intCode(countCommas(begin, end) + 1);
+        size_t count = 0;
+        const char* position = begin;
+        while (true)
+        {
+            position = skipSpace(position, end);
+            if (position == end && (count == 0 || count + 1 == intCode.size()))
+            {
+                // Empty line or a trailing comma
+                break;
+            }
+            if (position != end && *position == '+') {
+                position++;
+            }
+            std::from_chars_result result = std::from_chars(position, end, intCode[count]);
+            if (result.ec != std::errc()) {
+                throw std::runtime_error(error(result.ec, begin, position));
+            }
+            count++;
+            position = skipSpace(result.ptr, end);
+            if (position == end) {
+                break;
+            }
+            if (*position != ',') {
+                throw std::runtime_error(error(std::errc::invalid_argument, begin, position));
+            }
+            position++;
+        }
+        intCode.resize(count);
+        return intCode;
+    }
+
+private:
+
+    static size_t countCommas(const char* begin, const char* end)
+    {
+        size_t count = 0;
+        const char* position = begin;
+#if defined(__SSE2__)
+        const __m128i comma = _mm_set1_epi8(',');
+        for (; end - position >= 16; position += 16)
+        {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+            count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, comma)));
+        }
+#endif
+        for (; position < end; position++) {
+            count += *position == ',';
+        }
+        return count;
+    }
+
+    static const char* skipSpace(const char* position, const char* end)
+    {
+        while (position != end && (*position == ' ' || *position == '\t' || *position == '\r')) {
+            position++;
+        }
+        return position;
+    }
+
+    static std::string error(std::errc ec, const char* begin, const char* position)
+    {
+        return std::string(ec == std::errc::result_out_of_range ? "Number out of range" : "Not a number") +
+            " in Intcode text at offset " + std::to_string(position - begin);
+    }
+};
+
+#endif /* INTCODE_LOADER_HPP */
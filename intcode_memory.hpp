@@ -0,0 +1,411 @@
+#ifndef INTCODE_MEMORY_HPP
+#define INTCODE_MEMORY_HPP
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <string>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define INTCODE_MEMORY_COW 1
+#endif
+
+// Intcode address space. Addresses below the dense limit (at least
+// DENSE_LIMIT cells, more if the image is larger) live in one flat region,
+// so the low region (image, stack, most data) is a single bounds check away.
+// Anything above is kept in fixed size pages allocated on the first write,
+// reads of untouched cells return 0 without allocating.
+//
+// On Linux the flat region is a private copy-on-write mapping of a memfd
+// holding the pristine image, shared by every copy of the memory. reset()
+// discards the private pages, so its cost follows the pages written since the
+// last reset instead of the image size. Small regions are copied back instead,
+// which is cheaper than the syscall and the faults that follow it.
+//
+// Every page of the flat region remembers whether it was written since it
+// last matched a snapshot (or the image), so snapshot() and restore() only
+// look at the pages written in between. Writes through dense() are not seen,
+// whoever makes them calls touchDense() and the next one looks at every page.
+//
+// Cells are of type Cell, addresses are always long long.
+template <typename Cell>
+class BasicIntcodeMemory
+{
+    struct Image;
+
+public:
+    static constexpr long long PAGE_SIZE = 512;             // Cells per page (4 KiB of 64 bit cells)
+    static constexpr long long DENSE_LIMIT = 1 << 16;       // Minimum number of cells in the flat region
+    static constexpr long long COPY_RESET_CELLS = 4096;     // Below this copying the image back beats discarding pages
+
+    typedef std::vector<Cell> Page;
+
+    // Contents of the memory at one point. Pages equal to the image are not
+    // stored, pages equal to the previous snapshot (or restored state) of the
+    // same memory are shared with it.
+    struct Snapshot
+    {
+        std::shared_ptr<Image> image;
+        std::vector< std::shared_ptr<const Page> > dense;   // nullptr for pages equal to the image
+        std::unordered_map< long long, std::shared_ptr<const Page> > sparse;
+        long long denseSize = 0;
+        long long size = 0;
+    };
+
+    BasicIntcodeMemory() : BasicIntcodeMemory(std::vector<Cell>()) { }
+
+    explicit BasicIntcodeMemory(const std::vector<Cell>& image)
+        :_image(std::make_shared<Image>(image))
+    {
+        map();
+        _denseSize = _size = _highWater = image.size();
+    }
+
+    BasicIntcodeMemory(const BasicIntcodeMemory& other)
+        :_image(other._image)
+    {
+        map();
+        copyFrom(other);
+    }
+
+    BasicIntcodeMemory& operator=(const BasicIntcodeMemory& other)
+    {
+        if (this != &other)
+        {
+            if (_image != other._image)
+            {
+                unmap();
+                _image = other._image;
+                map();
+            }
+            copyFrom(other);
+        }
+        return *this;
+    }
+
+    ~BasicIntcodeMemory()
+    {
+        unmap();
+    }
+
+    Snapshot snapshot()
+    {
+        Snapshot snapshot;
+        snapshot.image = _image;
+        snapshot.denseSize = _denseSize;
+        snapshot.size = _size;
+
+        const long long pages = (_denseSize + PAGE_SIZE - 1) / PAGE_SIZE;
+        snapshot.dense.resize(pages);
+        for (long long i = 0; i < pages; i++)
+        {
+            std::shared_ptr<const Page>& shared = _shared[i];
+            if (_dirty[i] || _touched)
+            {
+                const Cell* cells = _dense + i * PAGE_SIZE;
+                if (shared == nullptr || !std::equal(cells, cells + PAGE_SIZE, shared->begin())) {
+                    shared = pristine(i) ? nullptr : std::make_shared<const Page>(cells, cells + PAGE_SIZE);
+                }
+                _dirty[i] = 0;
+            }
+            snapshot.dense[i] = shared;
+        }
+        _touched = false;
+
+        for (auto& page : _pages) {
+            snapshot.sparse.emplace(page.first, std::make_shared<const Page>(page.second));
+        }
+        return snapshot;
+    }
+
+    // Brings the memory back to the snapshot, calling changed(address) for
+    // every cell of the flat region that gets a different value
+    template <typename Changed>
+    void restore(const Snapshot& snapshot, Changed changed)
+    {
+        if (snapshot.image != _image) {
+            throw std::runtime_error("Snapshot was taken from a different image");
+        }
+
+        const long long pages = (std::max(_denseSize, snapshot.denseSize) + PAGE_SIZE - 1) / PAGE_SIZE;
+        for (long long i = 0; i < pages; i++)
+        {
+            const bool stored = i < (long long) snapshot.dense.size() && snapshot.dense[i] != nullptr;
+            if (!_dirty[i] && !_touched && _shared[i] == (stored ? snapshot.dense[i] : nullptr)) {
+                continue;
+            }
+            for (long long address = i * PAGE_SIZE; address < (i + 1) * PAGE_SIZE; address++)
+            {
+                Cell value = stored ? (*snapshot.dense[i])[address - i * PAGE_SIZE] : pristineCell(address);
+                if (_dense[address] != value)
+                {
+                    _dense[address] = value;
+                    changed(address);
+                }
+            }
+            _shared[i] = stored ? snapshot.dense[i] : nullptr;
+            _dirty[i] = 0;
+        }
+
+        _pages.clear();
+        for (auto& page : snapshot.sparse) {
+            _pages.emplace(page.first, *page.second);
+        }
+        _touched = false;
+        _highWater = std::max(_highWater, pages * PAGE_SIZE);
+        _denseSize = snapshot.denseSize;
+        _size = snapshot.size;
+    }
+
+    // Back to the image the memory was created from
+    void reset()
+    {
+        const long long imageSize = _image->cells.size();
+#if defined(INTCODE_MEMORY_COW)
+        if (_highWater > COPY_RESET_CELLS)
+        {
+            const long long osPage = sysconf(_SC_PAGESIZE);
+            long long bytes = (_highWater * (long long) sizeof(Cell) + osPage - 1) / osPage * osPage;
+            if (madvise(_dense, bytes, MADV_DONTNEED) != 0) {
+                throw std::runtime_error("Unable to discard Intcode memory pages");
+            }
+        }
+        else
+#endif
+        {
+            std::copy(_image->cells.begin(), _image->cells.end(), _dense);
+            std::fill(_dense + imageSize, _dense + std::max(imageSize, _highWater), 0);
+        }
+        const long long pages = (_highWater + PAGE_SIZE - 1) / PAGE_SIZE;
+        std::fill(_dirty.begin(), _dirty.begin() + pages, 0);
+        std::fill(_shared.begin(), _shared.begin() + pages, nullptr);
+        _touched = false;
+        _pages.clear();
+        _denseSize = _size = _highWater = imageSize;
+    }
+
+    Cell get(long long address)
+    {
+        if ((unsigned long long) address < (unsigned long long) _denseSize) {
+            return _dense[address];
+        }
+        return getSlow(address);
+    }
+
+    void set(long long address, Cell value)
+    {
+        if ((unsigned long long) address < (unsigned long long) _denseSize)
+        {
+            _dense[address] = value;
+            _dirty[(unsigned long long) address / PAGE_SIZE] = 1;
+            if (address >= _size) {
+                _size = address + 1;
+            }
+        }
+        else {
+            setSlow(address, value);
+        }
+    }
+
+    // The flat region was written through dense(), every page counts as written
+    void touchDense() { _touched = true; }
+
+    // Flat low region, what compiled code gets to run on directly. It never
+    // moves, growing only extends denseSize() over zero cells.
+    Cell* dense() { return _dense; }
+    const Cell* dense() const { return _dense; }
+    long long denseSize() const { return _denseSize; }
+
+    // One past the highest address written, or read outside of the flat region
+    long long size() const { return _size; }
+
+    // Whether the program may run at address: below size(), or on a nonzero
+    // cell of the flat region. Compiled code writes there without moving size().
+    bool reached(long long address) const
+    {
+        return address < _size || ((unsigned long long) address < (unsigned long long) _denseSize && _dense[address] != 0);
+    }
+
+    // Calls visit(address, value) for every cell that differs from the image
+    template <typename Visit>
+    void forEachChanged(Visit visit)
+    {
+        for (long long address = 0; address < _denseSize; address++)
+        {
+            if (_dense[address] != pristineCell(address)) {
+                visit(address, _dense[address]);
+            }
+        }
+        for (auto& page : _pages)
+        for (long long i = 0; i < PAGE_SIZE; i++)
+        {
+            if (page.second[i] != 0) {
+                visit(page.first * PAGE_SIZE + i, page.second[i]);
+            }
+        }
+    }
+
+    // Pages holding cells, the dense region counts every page it spans
+    size_t pagesTouched() const
+    {
+        return (_denseSize + PAGE_SIZE - 1) / PAGE_SIZE + _pages.size();
+    }
+
+private:
+
+    // Pristine image, on Linux also written to a memfd the flat regions map
+    struct Image
+    {
+        explicit Image(const std::vector<Cell>& image)
+            :cells(image),
+            capacity(std::max(DENSE_LIMIT, ((long long) image.size() + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE))
+        {
+#if defined(INTCODE_MEMORY_COW)
+            const size_t bytes = image.size() * sizeof(Cell);
+            fd = memfd_create("intcode-image", MFD_CLOEXEC);
+            if (fd < 0 || ftruncate(fd, capacity * sizeof(Cell)) != 0 ||
+                (bytes > 0 && pwrite(fd, image.data(), bytes, 0) != (ssize_t) bytes)) {
+                throw std::runtime_error("Unable to create Intcode image file");
+            }
+#endif
+        }
+
+        ~Image()
+        {
+#if defined(INTCODE_MEMORY_COW)
+            if (fd >= 0) {
+                close(fd);
+            }
+#endif
+        }
+
+        std::vector<Cell> cells;
+        long long capacity;     // Cells in the flat region
+        int fd = -1;
+    };
+
+    void map()
+    {
+        const size_t bytes = _image->capacity * sizeof(Cell);
+        _dirty.assign(_image->capacity / PAGE_SIZE, 0);
+        _shared.assign(_image->capacity / PAGE_SIZE, nullptr);
+#if defined(INTCODE_MEMORY_COW)
+        void* region = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, _image->fd, 0);
+        if (region == MAP_FAILED) {
+            throw std::runtime_error("Unable to map Intcode image");
+        }
+        _dense = static_cast<Cell*>(region);
+#else
+        _dense = new Cell[_image->capacity]();
+        std::copy(_image->cells.begin(), _image->cells.end(), _dense);
+#endif
+    }
+
+    void unmap()
+    {
+        if (_dense == nullptr) {
+            return;
+        }
+#if defined(INTCODE_MEMORY_COW)
+        munmap(_dense, _image->capacity * sizeof(Cell));
+#else
+        delete[] _dense;
+#endif
+        _dense = nullptr;
+    }
+
+    Cell pristineCell(long long address)
+    {
+        return address < (long long) _image->cells.size() ? _image->cells[address] : 0;
+    }
+
+    bool pristine(long long page)
+    {
+        for (long long address = page * PAGE_SIZE; address < (page + 1) * PAGE_SIZE; address++)
+        {
+            if (_dense[address] != pristineCell(address)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Cells at or above denseSize are pristine in both regions, only the
+    // used part has to be copied
+    void copyFrom(const BasicIntcodeMemory& other)
+    {
+        reset();
+        std::memcpy(_dense, other._dense, other._denseSize * sizeof(Cell));
+        _pages = other._pages;
+        _shared = other._shared;
+        _dirty = other._dirty;
+        _touched = other._touched;
+        _denseSize = other._denseSize;
+        _size = other._size;
+        _highWater = other._denseSize;
+    }
+
+    void checkAddress(long long address)
+    {
+        if (address < 0) {
+            throw std::runtime_error("Access to negative address " + std::to_string(address));
+        }
+        _size = std::max(_size, address + 1);
+    }
+
+    // Covers address with the dense region, rounded up to a whole page
+    void growDense(long long address)
+    {
+        _denseSize = std::min(_image->capacity, (address / PAGE_SIZE + 1) * PAGE_SIZE);
+        _highWater = std::max(_highWater, _denseSize);
+    }
+
+    Cell getSlow(long long address)
+    {
+        checkAddress(address);
+        if (address < _image->capacity)
+        {
+            growDense(address);
+            return _dense[address];
+        }
+
+        auto page = _pages.find(address / PAGE_SIZE);
+        return page == _pages.end() ? 0 : page->second[address % PAGE_SIZE];
+    }
+
+    void setSlow(long long address, Cell value)
+    {
+        checkAddress(address);
+        if (address < _image->capacity)
+        {
+            growDense(address);
+            _dense[address] = value;
+            _dirty[address / PAGE_SIZE] = 1;
+            return;
+        }
+
+        Page& page = _pages[address / PAGE_SIZE];
+        if (page.empty()) {
+            page.resize(PAGE_SIZE, 0);
+        }
+        page[address % PAGE_SIZE] = value;
+    }
+
+    std::shared_ptr<Image> _image;
+    Cell* _dense = nullptr;
+    long long _denseSize = 0;
+    long long _highWater = 0;   // Largest denseSize since the last reset
+    std::unordered_map<long long, Page> _pages;
+    std::vector< std::shared_ptr<const Page> > _shared;    // Last snapshot page per dense page, nullptr for the image
+    std::vector<unsigned char> _dirty;                      // Page written since it matched _shared
+    bool _touched = false;                                  // Written through dense() since then
+    long long _size = 0;
+};
+
+typedef BasicIntcodeMemory<long long> IntcodeMemory;
+
+#endif /* INTCODE_MEMORY_HPP */
@@ -0,0 +1,46 @@
+#ifndef INTCODE_NATIVE_PROGRAM_HPP
+#define INTCODE_NATIVE_PROGRAM_HPP
+
+// Interface between IntcodeComputer and programs translated ahead of time to
+// C++ by intcode_translate. A translated function runs from the instruction
+// pointer until it reaches something the interpreter has to handle (I/O, halt,
+// an address outside of memory, an unknown jump target), a store lands on a
+// cell marked in the caller's code bitmap, a block the caller marked stale is
+// entered or a jump is reached with the instruction limit used up.
+struct IntcodeNative
+{
+    struct State
+    {
+        long long* memory;
+        long long memorySize;
+        const unsigned long long* codeBits;     // One bit per cell, covers memorySize cells
+        const unsigned char* staleBlocks;       // One byte per block, nonzero once its cells changed
+        long long relativeBase;
+        long long instructionPointer;
+        long long writeAddress;
+        unsigned long long instructionCount;
+        unsigned long long instructionLimit;    // Checked before every jump
+    };
+
+    enum ExitReason
+    {
+        EXIT_INTERPRET  = 0,    // Interpreter has to execute the instruction at instructionPointer
+        EXIT_CODE_WRITE = 1,    // Store hit the code cell at writeAddress
+        EXIT_BUDGET     = 2     // Instruction limit reached before the jump at instructionPointer
+    };
+
+    typedef ExitReason (*Function)(State&);
+
+    struct Program
+    {
+        const char* name;
+        const long long* image;         // Image the program was translated from
+        long long imageSize;
+        const unsigned char* codeMask;  // Cells holding translated instructions
+        const int* blockOf;             // Block of each cell, -1 outside of them
+        int blockCount;
+        Function run;
+    };
+};
+
+#endif /* INTCODE_NATIVE_PROGRAM_HPP */
@@ -0,0 +1,246 @@
+#ifndef INTCODE_OPTIMIZER_HPP
+#define INTCODE_OPTIMIZER_HPP
+
+#include <map>
+#include <set>
+#include <vector>
+#include "intcode_instruction_set.hpp"
+#include "intcode_disassembler.hpp"
+
+// Load-time pass over the control-flow graph of an image, producing decoded
+// instructions for the interpreter with position mode reads replaced by
+// immediates where the value is known:
+//
+//   - cells of the image no instruction stores to at a fixed address keep
+//     their loaded value, reads of them become constants
+//   - a store of a value computed from immediates is propagated to the reads
+//     of the same cell later in the basic block, when every indirect jump
+//     takes its target from such a constant cell: a jump whose target is
+//     computed at run time could land between the store and the read
+//
+// Stores through the relative base and code that was not found statically
+// can still write anywhere, so the results only hold as long as the cells in
+// watchedCells() keep their loaded values. IntcodeComputer checks that
+// through its code bitmap and drops the optimized instructions once one of
+// them is written.
+class IntcodeOptimizer : private IntcodeInstructionSet
+{
+public:
+
+    struct Stats
+    {
+        size_t instructions = 0;        // Instructions found from the entry points
+        size_t optimized = 0;           // Instructions with at least one operand folded
+        size_t constantCells = 0;       // Cells read as constants
+        size_t foldedOperands = 0;      // Operand reads replaced by immediates, of them
+        size_t propagatedOperands = 0;  // ...with a value stored earlier in the block
+        size_t decidedJumps = 0;        // Conditional jumps whose condition became a constant
+    };
+
+    explicit IntcodeOptimizer(const std::vector<long long>& image)
+        :_optimized(image.size()), _watched(image.size(), 0)
+    {
+        IntcodeDisassembler program(image);
+        _stats.instructions = program.instructions().size();
+        findConstantCells(program);
+
+        std::set<long long> targets;
+        if (indirectTargets(program, targets))
+        {
+            for (auto& block : program.blocks()) {
+                propagate(program, block.second, targets);
+            }
+        }
+    }
+
+    // Instruction to run at address as long as its cells hold their loaded values, null if unchanged
+    const DecodedInstruction* optimized(long long address) const
+    {
+        if (address < 0 || address >= (long long) _optimized.size() || _optimized[address].opCode == 0) {
+            return nullptr;
+        }
+        return &_optimized[address];
+    }
+
+    bool watches(long long address) const
+    {
+        return address >= 0 && address < (long long) _watched.size() && _watched[address];
+    }
+
+    std::vector<long long> watchedCells() const
+    {
+        std::vector<long long> cells;
+        for (long long address = 0; address < (long long) _watched.size(); address++) {
+            if (_watched[address]) cells.push_back(address);
+        }
+        return cells;
+    }
+
+    Stats stats() const { return _stats; }
+
+private:
+
+    // Operands read by the instruction, the rest is its store target
+    static int inputCount(const DecodedInstruction& instr)
+    {
+        switch (instr.opCode)
+        {
+            case ADD: case MULT: case LESS_THAN: case EQUALS: case JUMP_IF_TRUE: case JUMP_IF_FALSE:
+                return 2;
+
+            case OUTPUT: case BASE_OP:
+                return 1;
+
+            default:
+                return 0;
+        };
+    }
+
+    static bool stores(const DecodedInstruction& instr)
+    {
+        return instr.opCode == INPUT || instr.length == 4;
+    }
+
+    static int storeOperand(const DecodedInstruction& instr)
+    {
+        return instr.opCode == INPUT ? 0 : 2;
+    }
+
+    void findConstantCells(const IntcodeDisassembler& program)
+    {
+        _constant.assign(_optimized.size(), 1);
+        for (auto& entry : program.instructions())
+        {
+            const DecodedInstruction& instr = entry.second.decoded;
+            if (!stores(instr)) {
+                continue;
+            }
+            const int target = storeOperand(instr);
+            long long address = instr.modes[target] == IMMEDIATE_MODE ? entry.first + 1 + target : instr.operands[target];
+            if (instr.modes[target] != RELATIVE_MODE && address >= 0 && address < (long long) _constant.size()) {
+                _constant[address] = 0;
+            }
+        }
+    }
+
+    // Targets of the jumps that do not name theirs as an immediate, false if
+    // one of them reads it from a cell that may change
+    bool indirectTargets(const IntcodeDisassembler& program, std::set<long long>& targets) const
+    {
+        for (auto& entry : program.instructions())
+        {
+            const DecodedInstruction& instr = entry.second.decoded;
+            if ((instr.opCode != JUMP_IF_TRUE && instr.opCode != JUMP_IF_FALSE) || instr.modes[1] == IMMEDIATE_MODE) {
+                continue;
+            }
+            const long long cell = instr.operands[1];
+            if (instr.modes[1] != POSITION_MODE || cell < 0 || cell >= (long long) _constant.size() || !_constant[cell]) {
+                return false;
+            }
+            targets.insert(program.image()[cell]);
+        }
+        return true;
+    }
+
+    static long long evaluate(const DecodedInstruction& instr)
+    {
+        const unsigned long long a = instr.operands[0], b = instr.operands[1];
+        switch (instr.opCode)
+        {
+            case ADD:
+                return (long long) (a + b);
+
+            case MULT:
+                return (long long) (a * b);
+
+            case LESS_THAN:
+                return instr.operands[0] < instr.operands[1] ? 1 : 0;
+
+            default:
+                return instr.operands[0] == instr.operands[1] ? 1 : 0;
+        };
+    }
+
+    void watch(long long first, long long last)
+    {
+        for (long long address = first; address < last; address++) {
+            _watched[address] = 1;
+        }
+    }
+
+    void propagate(const IntcodeDisassembler& program, const IntcodeDisassembler::Block& block,
+        const std::set<long long>& targets)
+    {
+        std::map<long long, std::pair<long long, long long> > known;     // Cell to (value, address of the store)
+        for (long long address : block.instructions)
+        {
+            if (address != block.begin && targets.count(address)) {
+                known.clear();
+            }
+            DecodedInstruction instr = program.instructions().at(address).decoded;
+
+            bool changed = false;
+            for (int i = 0; i < inputCount(instr); i++)
+            {
+                if (instr.modes[i] != POSITION_MODE) {
+                    continue;
+                }
+                const long long cell = instr.operands[i];
+                auto stored = known.find(cell);
+                if (stored != known.end())
+                {
+                    instr.operands[i] = stored->second.first;
+                    watch(stored->second.second, stored->second.second + 4);
+                    _stats.propagatedOperands++;
+                }
+                else if (cell >= 0 && cell < (long long) _constant.size() && _constant[cell])
+                {
+                    instr.operands[i] = program.image()[cell];
+                    if (!_watched[cell]) _stats.constantCells++;
+                    watch(cell, cell + 1);
+                }
+                else {
+                    continue;
+                }
+                instr.modes[i] = IMMEDIATE_MODE;
+                _stats.foldedOperands++;
+                changed = true;
+            }
+
+            if (changed)
+            {
+                _optimized[address] = instr;
+                _stats.optimized++;
+                if ((instr.opCode == JUMP_IF_TRUE || instr.opCode == JUMP_IF_FALSE) && instr.modes[0] == IMMEDIATE_MODE &&
+                    program.instructions().at(address).decoded.modes[0] != IMMEDIATE_MODE) {
+                    _stats.decidedJumps++;
+                }
+            }
+
+            if (!stores(instr)) {
+                continue;
+            }
+            const int target = storeOperand(instr);
+            if (instr.modes[target] == RELATIVE_MODE)
+            {
+                // Could be any cell
+                known.clear();
+                continue;
+            }
+            const long long cell = instr.modes[target] == IMMEDIATE_MODE ? address + 1 + target : instr.operands[target];
+            if (instr.opCode != INPUT && instr.modes[0] == IMMEDIATE_MODE && instr.modes[1] == IMMEDIATE_MODE) {
+                known[cell] = std::make_pair(evaluate(instr), address);
+            }
+            else {
+                known.erase(cell);
+            }
+        }
+    }
+
+    std::vector<DecodedInstruction> _optimized;     // opCode 0 where the loaded instruction is kept
+    std::vector<unsigned char> _constant;           // Not stored to at a fixed address by any instruction found
+    std::vector<unsigned char> _watched;
+    Stats _stats;
+};
+
+#endif /* INTCODE_OPTIMIZER_HPP */
@@ -0,0 +1,163 @@
+#ifndef INTCODE_PROFILE_HPP
+#define INTCODE_PROFILE_HPP
+
+#include <map>
+#include <vector>
+#include <string>
+#include <utility>
+#include <ostream>
+
+// Execution counts gathered by IntcodeComputer when built with INTCODE_PROFILE
+// and profiling is switched on: per opcode, per opcode and parameter modes
+// (the instruction word), per instruction address, and taken / not taken for
+// the conditional jumps. Fused pairs count as their two instructions.
+class IntcodeProfile
+{
+public:
+
+    struct Jumps
+    {
+        unsigned long long taken = 0;
+        unsigned long long notTaken = 0;
+    };
+
+    void instruction(long long address, long long word)
+    {
+        if (address >= (long long) _addresses.size()) {
+            _addresses.resize(address + 1);
+        }
+        Site& site = _addresses[address];
+        if (site.word != word)
+        {
+            // Code at the address was rewritten, what ran before keeps its own entry
+            retire(address, site);
+            site = Site();
+            site.word = word;
+        }
+        site.count++;
+    }
+
+    // The instruction at address did not execute after all (INPUT waiting for input)
+    void retract(long long address)
+    {
+        _addresses[address].count--;
+    }
+
+    void jump(long long address, bool taken)
+    {
+        Site& site = _addresses[address];
+        (taken ? site.jumps.taken : site.jumps.notTaken)++;
+    }
+
+    void clear()
+    {
+        _addresses.clear();
+        _retired.clear();
+    }
+
+    // Executions per opcode
+    std::map<int, unsigned long long> opcodes() const
+    {
+        std::map<int, unsigned long long> counts;
+        for (auto& site : sites()) {
+            counts[site.first.second % 100] += site.second.count;
+        }
+        return counts;
+    }
+
+    // Executions per instruction word, opcode with its parameter modes
+    std::map<long long, unsigned long long> words() const
+    {
+        std::map<long long, unsigned long long> counts;
+        for (auto& site : sites()) {
+            counts[site.first.second] += site.second.count;
+        }
+        return counts;
+    }
+
+    // address,word,opcode,modes,count,taken,not_taken
+    void writeCsv(std::ostream& out) const
+    {
+        out << "address,word,opcode,modes,count,taken,not_taken\n";
+        for (auto& site : sites())
+        {
+            const long long word = site.first.second;
+            out << site.first.first << ',' << word << ',' << name(word % 100) << ',' << modes(word) << ','
+                << site.second.count << ',' << site.second.jumps.taken << ',' << site.second.jumps.notTaken << '\n';
+        }
+    }
+
+    // Folded stacks (flamegraph.pl, speedscope): program;opcode;modes;address count
+    void writeFolded(std::ostream& out, const std::string& program = "intcode") const
+    {
+        for (auto& site : sites())
+        {
+            const long long word = site.first.second;
+            out << program << ';' << name(word % 100) << ';' << name(word % 100) << '_' << modes(word)
+                << ";@" << site.first.first << ' ' << site.second.count << '\n';
+        }
+    }
+
+private:
+
+    struct Site
+    {
+        long long word = -1;
+        unsigned long long count = 0;
+        Jumps jumps;
+    };
+
+    void retire(long long address, const Site& site)
+    {
+        if (site.count == 0) {
+            return;
+        }
+        Site& retired = _retired[std::make_pair(address, site.word)];
+        retired.word = site.word;
+        retired.count += site.count;
+        retired.jumps.taken += site.jumps.taken;
+        retired.jumps.notTaken += site.jumps.notTaken;
+    }
+
+    // Every (address, word) executed, ordered by address
+    std::map< std::pair<long long, long long>, Site > sites() const
+    {
+        std::map< std::pair<long long, long long>, Site > all = _retired;
+        for (long long address = 0; address < (long long) _addresses.size(); address++)
+        {
+            const Site& site = _addresses[address];
+            if (site.count == 0) {
+                continue;
+            }
+            Site& merged = all[std::make_pair(address, site.word)];
+            merged.word = site.word;
+            merged.count += site.count;
+            merged.jumps.taken += site.jumps.taken;
+            merged.jumps.notTaken += site.jumps.notTaken;
+        }
+        return all;
+    }
+
+    static std::string name(int opCode)
+    {
+        static const char* const names[] = {
+            "INVALID", "ADD", "MULT", "INPUT", "OUTPUT", "JUMP_IF_TRUE", "JUMP_IF_FALSE", "LESS_THAN", "EQUALS", "BASE_OP"
+        };
+        if (opCode == 99) {
+            return "HALT";
+        }
+        return names[opCode > 0 && opCode < 10 ? opCode : 0];
+    }
+
+    // Parameter modes as written in the word, first parameter last ("011" for 1101)
+    static std::string modes(long long word)
+    {
+        const std::string digits = std::to_string(word / 100);
+        return digits.size() < 3 ? std::string(3 - digits.size(), '0') + digits : digits;
+    }
+
+    std::vector<Site> _addresses;
+    std::map< std::pair<long long, long long>, Site > _retired;     // Counts of words since overwritten
+};
+
+#endif /* INTCODE_PROFILE_HPP */
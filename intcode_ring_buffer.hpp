@@ -0,0 +1,67 @@
+#ifndef INTCODE_RING_BUFFER_HPP
+#define INTCODE_RING_BUFFER_HPP
+
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+
+// FIFO over a power of two sized buffer, doubles when full. Used for the
+// input and output queues of IntcodeComputer.
+template <typename T>
+class IntcodeRingBuffer
+{
+public:
+    explicit IntcodeRingBuffer(size_t capacity = 64)
+    {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        _buffer.resize(size);
+    }
+
+    bool empty() const { return _head == _tail; }
+    size_t size() const { return _tail - _head; }
+
+    void push(const T& value)
+    {
+        if (size() == _buffer.size()) {
+            grow();
+        }
+        _buffer[_tail++ & (_buffer.size() - 1)] = value;
+    }
+
+    T pop()
+    {
+        if (empty()) {
+            throw std::runtime_error("Pop from an empty Intcode queue");
+        }
+        return _buffer[_head++ & (_buffer.size() - 1)];
+    }
+
+    const T& front() const
+    {
+        if (empty()) {
+            throw std::runtime_error("Front of an empty Intcode queue");
+        }
+        return _buffer[_head & (_buffer.size() - 1)];
+    }
+
+    void clear() { _head = _tail = 0; }
+
+private:
+
+    void grow()
+    {
+        std::vector<T> buffer(_buffer.size() * 2);
+        for (size_t i = 0; i < size(); i++) {
+            buffer[i] = _buffer[(_head + i) & (_buffer.size() - 1)];
+        }
+        _tail = size();
+        _head = 0;
+        _buffer.swap(buffer);
+    }
+
+    std::vector<T> _buffer;
+    size_t _head = 0, _tail = 0;    // Running counts, wrapped by the mask on access
+};
+
+#endif /* INTCODE_RING_BUFFER_HPP */
@@ -0,0 +1,475 @@
+#ifndef INTCODE_SCHEDULER_HPP
+#define INTCODE_SCHEDULER_HPP
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <stdexcept>
+#include "intcode_computer.hpp"
+
+// Unbounded single producer / single consumer queue of values, lock-free.
+// Values are stored in fixed size segments linked as the producer fills them,
+// the consumer hands the segment it finished back for reuse.
+class IntcodeChannel
+{
+public:
+    IntcodeChannel()
+    {
+        _head = _tail = new Segment();
+    }
+
+    IntcodeChannel(const IntcodeChannel&) = delete;
+    IntcodeChannel& operator=(const IntcodeChannel&) = delete;
+
+    ~IntcodeChannel()
+    {
+        while (_head != nullptr)
+        {
+            Segment* next = _head->next.load(std::memory_order_relaxed);
+            delete _head;
+            _head = next;
+        }
+        delete _spare.load(std::memory_order_relaxed);
+    }
+
+    // Producer side
+    void push(long long value)
+    {
+        const size_t written = _written.load(std::memory_order_relaxed);
+        if (written > 0 && written % SEGMENT_SIZE == 0)
+        {
+            Segment* segment = _spare.exchange(nullptr, std::memory_order_acquire);
+            if (segment == nullptr) {
+                segment = new Segment();
+            }
+            segment->next.store(nullptr, std::memory_order_relaxed);
+            _tail->next.store(segment, std::memory_order_release);
+            _tail = segment;
+        }
+        _tail->values[written % SEGMENT_SIZE] = value;
+        _written.store(written + 1, std::memory_order_release);
+    }
+
+    // Consumer side
+    bool pop(long long& value)
+    {
+        const size_t read = _read.load(std::memory_order_relaxed);
+        if (read == _written.load(std::memory_order_acquire)) {
+            return false;
+        }
+        if (read > 0 && read % SEGMENT_SIZE == 0)
+        {
+            Segment* done = _head;
+            _head = _head->next.load(std::memory_order_acquire);
+            delete _spare.exchange(done, std::memory_order_release);
+        }
+        value = _head->values[read % SEGMENT_SIZE];
+        _read.store(read + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Any thread, a VM that parks checks its input while a worker that woke
+    // it may already be popping
+    bool empty() const { return _read.load(std::memory_order_acquire) == _written.load(std::memory_order_acquire); }
+
+private:
+
+    static const size_t SEGMENT_SIZE = 256;
+
+    struct Segment
+    {
+        std::atomic<Segment*> next {nullptr};
+        long long values[SEGMENT_SIZE];
+    };
+
+    alignas(64) std::atomic<size_t> _written {0};
+    alignas(64) Segment* _tail;         // Producer only
+    alignas(64) Segment* _head;         // Consumer only
+    std::atomic<size_t> _read {0};
+    std::atomic<Segment*> _spare {nullptr};
+};
+
+// Runs a fleet of IntcodeComputers on a pool of worker threads.
+//
+// VMs are connected by channels (one VM's outputs become another one's
+// inputs) and run in slices of a fixed instruction budget. A VM that reaches
+// an INPUT with nothing to read is parked until its producer pushes a value.
+// Every worker keeps a deque of runnable VMs and steals from the others when
+// its own runs dry. run() returns once every VM halted or is parked.
+class IntcodeScheduler
+{
+    struct Vm;
+
+public:
+    static const unsigned long long DEFAULT_SLICE = 20000;
+
+    struct WorkerStats
+    {
+        unsigned long long instructions = 0;
+        unsigned long long slices = 0;
+        unsigned long long contextSwitches = 0;     // Slices that ended with the VM not halted
+        unsigned long long steals = 0;
+        double idleSeconds = 0;
+    };
+
+    struct Stats
+    {
+        double seconds = 0;
+        unsigned long long instructions = 0;
+        unsigned long long contextSwitches = 0;
+        std::vector<WorkerStats> workers;
+
+        double instructionsPerSecond() const { return seconds > 0 ? instructions / seconds : 0; }
+    };
+
+    explicit IntcodeScheduler(size_t workers = std::thread::hardware_concurrency(), unsigned long long slice = DEFAULT_SLICE)
+        :_workerCount(std::max<size_t>(1, workers)), _slice(slice)
+    { }
+
+    // Adds a VM, returns its index
+    size_t add(IntcodeComputer computer)
+    {
+        _vms.emplace_back(new Vm(std::move(computer)));
+        _channels.emplace_back(new IntcodeChannel());
+        _vms.back()->output = _channels.back().get();
+        return _vms.size() - 1;
+    }
+
+    // Outputs of from become the inputs of to
+    void connect(size_t from, size_t to)
+    {
+        Vm& consumer = *_vms.at(to);
+        if (consumer.input != nullptr) {
+            throw std::runtime_error("VM " + std::to_string(to) + " already has an input");
+        }
+        consumer.input = _vms.at(from)->output;
+        _vms[from]->consumer = &consumer;
+    }
+
+    // Queues an input for the VM, only between runs
+    void send(size_t vm, long long value)
+    {
+        Vm& target = *_vms.at(vm);
+        if (target.input == nullptr)
+        {
+            _channels.emplace_back(new IntcodeChannel());
+            target.input = _channels.back().get();
+        }
+        target.input->push(value);
+    }
+
+    // Outputs of the VM nobody consumed, only between runs
+    std::vector<long long> receive(size_t vm)
+    {
+        std::vector<long long> values;
+        long long value;
+        while (_vms.at(vm)->output->pop(value)) {
+            values.push_back(value);
+        }
+        return values;
+    }
+
+    // Every VM back to its image with the channels emptied, connections
+    // stay. Only between runs, a fleet can be run again without rebuilding it.
+    void reset()
+    {
+        long long value;
+        for (auto& channel : _channels) {
+            while (channel->pop(value)) { }
+        }
+        for (auto& vm : _vms)
+        {
+            vm->computer.reset();
+            vm->state.store(RUNNABLE);
+        }
+    }
+
+    IntcodeComputer& computer(size_t vm) { return _vms.at(vm)->computer; }
+    bool isHalted(size_t vm) { return _vms.at(vm)->state.load() == HALTED; }
+    size_t size() { return _vms.size(); }
+
+    Stats run()
+    {
+        _workers.clear();
+        for (size_t i = 0; i < _workerCount; i++) {
+            _workers.emplace_back(new Worker(_vms.size(), i));
+        }
+
+        size_t next = 0;
+        for (auto& vm : _vms)
+        {
+            if (vm->state.load() == HALTED) {
+                continue;
+            }
+            vm->state.store(RUNNABLE);
+            _active.fetch_add(1);
+            _workers[next++ % _workerCount]->queue.push(vm.get());
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < _workerCount; i++) {
+            threads.emplace_back(&IntcodeScheduler::work, this, std::ref(*_workers[i]));
+        }
+        work(*_workers[0]);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        Stats stats;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        for (auto& worker : _workers)
+        {
+            stats.workers.push_back(worker->stats);
+            stats.instructions += worker->stats.instructions;
+            stats.contextSwitches += worker->stats.contextSwitches;
+        }
+        return stats;
+    }
+
+private:
+
+    enum VmState
+    {
+        RUNNABLE,   // Queued or running
+        PARKED,     // Waiting for input
+        HALTED
+    };
+
+    struct Vm
+    {
+        explicit Vm(IntcodeComputer&& computer) : computer(std::move(computer)) { }
+
+        IntcodeComputer computer;
+        IntcodeChannel* input = nullptr;
+        IntcodeChannel* output = nullptr;
+        Vm* consumer = nullptr;             // Reads output, woken after a push
+        std::atomic<int> state {RUNNABLE};
+    };
+
+    // Chase-Lev work stealing deque. A VM sits in at most one deque at a
+    // time, so a buffer with room for every VM never has to grow.
+    class WorkQueue
+    {
+    public:
+        explicit WorkQueue(size_t capacity)
+        {
+            size_t size = 1;
+            while (size < capacity) size <<= 1;
+            _buffer = std::vector< std::atomic<Vm*> >(size);
+            _mask = size - 1;
+        }
+
+        // Owner only
+        void push(Vm* vm)
+        {
+            const long long bottom = _bottom.load(std::memory_order_relaxed);
+            _buffer[bottom & _mask].store(vm, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+
+        // Owner only, takes the most recently pushed VM
+        Vm* pop()
+        {
+            const long long bottom = _bottom.load(std::memory_order_relaxed) - 1;
+            _bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            long long top = _top.load(std::memory_order_relaxed);
+            if (top > bottom)
+            {
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            Vm* vm = _buffer[bottom & _mask].load(std::memory_order_relaxed);
+            if (top == bottom)
+            {
+                // Last one, race the thieves for it
+                if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    vm = nullptr;
+                }
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+            return vm;
+        }
+
+        // Any thread, takes the oldest VM
+        Vm* steal()
+        {
+            long long top = _top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const long long bottom = _bottom.load(std::memory_order_acquire);
+            if (top >= bottom) {
+                return nullptr;
+            }
+
+            Vm* vm = _buffer[top & _mask].load(std::memory_order_relaxed);
+            if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return vm;
+        }
+
+    private:
+        alignas(64) std::atomic<long long> _top {0};
+        alignas(64) std::atomic<long long> _bottom {0};
+        std::vector< std::atomic<Vm*> > _buffer;
+        size_t _mask = 0;
+    };
+
+    struct Worker
+    {
+        Worker(size_t capacity, size_t index) : queue(capacity), random(index * 2654435761u + 1) { }
+
+        WorkQueue queue;
+        WorkerStats stats;
+        unsigned long long random;
+    };
+
+    void work(Worker& worker)
+    {
+        std::chrono::steady_clock::time_point idleSince;
+        bool idle = false;
+        while (true)
+        {
+            Vm* vm = worker.queue.pop();
+            if (vm == nullptr) {
+                vm = steal(worker);
+            }
+
+            if (vm == nullptr)
+            {
+                if (!idle)
+                {
+                    idle = true;
+                    idleSince = std::chrono::steady_clock::now();
+                }
+                // Nothing runnable or running anywhere, every VM halted or is parked
+                if (_active.load() == 0) {
+                    break;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+
+            if (idle)
+            {
+                worker.stats.idleSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - idleSince).count();
+                idle = false;
+            }
+            runSlice(worker, *vm);
+        }
+
+        if (idle) {
+            worker.stats.idleSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - idleSince).count();
+        }
+    }
+
+    Vm* steal(Worker& worker)
+    {
+        if (_workerCount == 1) {
+            return nullptr;
+        }
+        worker.random ^= worker.random << 13;
+        worker.random ^= worker.random >> 7;
+        worker.random ^= worker.random << 17;
+        const size_t first = worker.random % _workerCount;
+        for (size_t i = 0; i < _workerCount; i++)
+        {
+            Worker& victim = *_workers[(first + i) % _workerCount];
+            if (&victim == &worker) {
+                continue;
+            }
+            Vm* vm = victim.queue.steal();
+            if (vm != nullptr)
+            {
+                worker.stats.steals++;
+                return vm;
+            }
+        }
+        return nullptr;
+    }
+
+    void runSlice(Worker& worker, Vm& vm)
+    {
+        long long value;
+        while (vm.input != nullptr && vm.input->pop(value)) {
+            vm.computer.pushInput(value);
+        }
+
+        const unsigned long long before = vm.computer.getInstructionCount();
+        IntcodeComputer::StopReason reason = vm.computer.run(_slice);
+        worker.stats.instructions += vm.computer.getInstructionCount() - before;
+        worker.stats.slices++;
+
+        bool produced = false;
+        while (vm.computer.hasOutput())
+        {
+            vm.output->push(vm.computer.popOutput());
+            produced = true;
+        }
+        if (produced && vm.consumer != nullptr) {
+            wake(worker, *vm.consumer);
+        }
+
+        switch (reason)
+        {
+            case IntcodeComputer::StopReason::BUDGET_EXHAUSTED:
+                worker.stats.contextSwitches++;
+                worker.queue.push(&vm);
+                break;
+
+            case IntcodeComputer::StopReason::NEED_INPUT:
+                worker.stats.contextSwitches++;
+                park(worker, vm);
+                break;
+
+            default:
+                vm.state.store(HALTED);
+                _active.fetch_sub(1);
+                break;
+        };
+    }
+
+    // The producer may push between the empty check and the state change, so
+    // the channel is checked again once the VM is marked as parked
+    void park(Worker& worker, Vm& vm)
+    {
+        vm.state.store(PARKED);
+        if (vm.input != nullptr && !vm.input->empty())
+        {
+            int expected = PARKED;
+            if (vm.state.compare_exchange_strong(expected, RUNNABLE))
+            {
+                worker.queue.push(&vm);
+                return;
+            }
+        }
+        _active.fetch_sub(1);
+    }
+
+    // Only the pushing VM's worker wakes a consumer, so it goes on that
+    // worker's own deque. The producer is still counted as active, _active
+    // cannot drop to zero in between.
+    void wake(Worker& worker, Vm& vm)
+    {
+        int expected = PARKED;
+        if (vm.state.compare_exchange_strong(expected, RUNNABLE))
+        {
+            _active.fetch_add(1);
+            worker.queue.push(&vm);
+        }
+    }
+
+    size_t _workerCount;
+    unsigned long long _slice;
+    std::vector< std::unique_ptr<Vm> > _vms;
+    std::vector< std::unique_ptr<IntcodeChannel> > _channels;
+    std::vector< std::unique_ptr<Worker> > _workers;
+    std::atomic<long long> _active {0};     // VMs runnable or running
+};
+
+#endif /* INTCODE_SCHEDULER_HPP */
@@ -0,0 +1,196 @@
+#ifndef INTCODE_SWEEP_HPP
+#define INTCODE_SWEEP_HPP
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <limits>
+#include <utility>
+#include <functional>
+#include <exception>
+#include "intcode_computer.hpp"
+
+// Runs one program many times with a few memory cells patched per job and
+// looks for the first job whose finished VM satisfies a predicate
+//
+//   IntcodeSweep sweep(image);
+//   auto result = sweep.find(jobs, [](IntcodeComputer& ic) { return ic.getMemory(0) == 19690720; });
+//
+// Every thread keeps one VM for the lifetime of the sweep. Between jobs it is
+// brought back with a restore of the pristine snapshot, which rewrites only
+// the cells the last job changed and keeps the decoded and compiled code.
+// Jobs are handed out in order, once a job matches no later job is started,
+// so the result is the lowest matching job no matter how many threads run.
+class IntcodeSweep
+{
+public:
+    typedef std::vector< std::pair<long long, long long> > Patch;   // (address, value) pairs
+    typedef std::function<bool(IntcodeComputer&)> Predicate;        // Called from several threads at once
+
+    static const size_t NO_MATCH = std::numeric_limits<size_t>::max();
+    static constexpr unsigned long long DEFAULT_SLICE = 100000;
+
+    struct Result
+    {
+        size_t job = NO_MATCH;
+        unsigned long long jobsRun = 0;
+        unsigned long long jobsFaulted = 0;     // Threw or ran out of the job budget, cancelled jobs are not counted
+        unsigned long long instructions = 0;
+        double seconds = 0;
+
+        bool found() const { return job != NO_MATCH; }
+    };
+
+    explicit IntcodeSweep(const std::vector<long long>& image, size_t threads = std::thread::hardware_concurrency(),
+        IntcodeComputer::Backend backend = IntcodeComputer::defaultBackend(IntcodeComputer::Backend::PREDECODED))
+    {
+        for (size_t i = 0; i < std::max<size_t>(1, threads); i++) {
+            _workers.emplace_back(new Worker(image, backend));
+        }
+    }
+
+    // Instructions a single job may execute before it counts as faulted
+    void setJobBudget(unsigned long long budget) { _jobBudget = budget; }
+
+    Result find(const std::vector<Patch>& jobs, const Predicate& predicate)
+    {
+        _jobs = &jobs;
+        _predicate = &predicate;
+        _next.store(0);
+        _match.store(NO_MATCH);
+        _failed.store(false);
+        _exception = nullptr;
+
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < _workers.size(); i++) {
+            threads.emplace_back(&IntcodeSweep::work, this, std::ref(*_workers[i]));
+        }
+        work(*_workers[0]);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        if (_exception) {
+            std::rethrow_exception(_exception);
+        }
+
+        Result result;
+        result.job = _match.load();
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        for (auto& worker : _workers)
+        {
+            result.jobsRun += worker->jobsRun;
+            result.jobsFaulted += worker->jobsFaulted;
+            result.instructions += worker->instructions;
+        }
+        return result;
+    }
+
+private:
+
+    struct Worker
+    {
+        Worker(const std::vector<long long>& image, IntcodeComputer::Backend backend)
+            :computer(image)
+        {
+            computer.setVerbosity(false);
+            computer.setBackend(backend);
+            pristine = computer.snapshot();
+        }
+
+        IntcodeComputer computer;
+        IntcodeComputer::Snapshot pristine;
+        unsigned long long jobsRun = 0, jobsFaulted = 0, instructions = 0;
+    };
+
+    void work(Worker& worker)
+    {
+        worker.jobsRun = worker.jobsFaulted = worker.instructions = 0;
+        IntcodeComputer& ic = worker.computer;
+        while (true)
+        {
+            const size_t job = _next.fetch_add(1);
+            if (job >= _jobs->size() || job > _match.load(std::memory_order_relaxed) || _failed.load()) {
+                return;
+            }
+
+            ic.restore(worker.pristine);
+            const unsigned long long before = ic.getInstructionCount();
+            worker.jobsRun++;
+
+            JobEnd end = FAULTED;
+            try {
+                end = runJob(ic, job);
+            }
+            catch (const std::exception&) { }
+            worker.instructions += ic.getInstructionCount() - before;
+            if (end != FINISHED)
+            {
+                worker.jobsFaulted += end == FAULTED;
+                continue;
+            }
+
+            bool matched = false;
+            try {
+                matched = (*_predicate)(ic);
+            }
+            catch (...)
+            {
+                // First predicate failure is rethrown, the others stop at their next job
+                if (!_failed.exchange(true)) {
+                    _exception = std::current_exception();
+                }
+                return;
+            }
+            if (matched) {
+                lowerMatch(job);
+            }
+        }
+    }
+
+    enum JobEnd { FINISHED, FAULTED, CANCELLED };
+
+    // Runs the job in slices so a match on an earlier job cancels it
+    JobEnd runJob(IntcodeComputer& ic, size_t job)
+    {
+        for (auto& cell : (*_jobs)[job]) {
+            ic.setMemory(cell.first, cell.second);
+        }
+
+        const unsigned long long start = ic.getInstructionCount(),
+            limit = _jobBudget > IntcodeComputer::NO_BUDGET - start ? IntcodeComputer::NO_BUDGET : start + _jobBudget;
+        while (true)
+        {
+            const unsigned long long count = ic.getInstructionCount();
+            if (count >= limit) {
+                return FAULTED;
+            }
+            if (ic.run(std::min(DEFAULT_SLICE, limit - count)) != IntcodeComputer::StopReason::BUDGET_EXHAUSTED) {
+                return FINISHED;
+            }
+            if (_match.load(std::memory_order_relaxed) < job || _failed.load()) {
+                return CANCELLED;
+            }
+        }
+    }
+
+    void lowerMatch(size_t job)
+    {
+        size_t current = _match.load();
+        while (job < current && !_match.compare_exchange_weak(current, job)) { }
+    }
+
+    std::vector< std::unique_ptr<Worker> > _workers;
+    unsigned long long _jobBudget = IntcodeComputer::NO_BUDGET;
+
+    const std::vector<Patch>* _jobs = nullptr;
+    const Predicate* _predicate = nullptr;
+    std::atomic<size_t> _next {0};
+    std::atomic<size_t> _match {NO_MATCH};     // Lowest matching job so far
+    std::atomic<bool> _failed {false};
+    std::exception_ptr _exception;
+};
+
+#endif /* INTCODE_SWEEP_HPP */
@@ -0,0 +1,503 @@
+#ifndef INTCODE_SYMBOLIC_HPP
+#define INTCODE_SYMBOLIC_HPP
+
+#include <map>
+#include <vector>
+#include <string>
+#include <optional>
+#include <stdexcept>
+#include <algorithm>
+#include "intcode_instruction_set.hpp"
+
+// Polynomial with integer coefficients over the initial values of memory
+// cells, [k] stands for whatever cell k held when the program started.
+// Arithmetic wraps around like the VM's 64 bit cells.
+class IntcodePolynomial
+{
+public:
+    typedef std::vector<long long> Monomial;    // Sorted cells, repeated for powers
+
+    IntcodePolynomial(long long constant = 0)
+    {
+        if (constant != 0) {
+            _terms[Monomial()] = constant;
+        }
+    }
+
+    static IntcodePolynomial cell(long long address)
+    {
+        IntcodePolynomial p;
+        p._terms[Monomial {address}] = 1;
+        return p;
+    }
+
+    bool isConstant() const { return _terms.empty() || (_terms.size() == 1 && _terms.begin()->first.empty()); }
+    long long constant() const
+    {
+        auto term = _terms.find(Monomial());
+        return term != _terms.end() ? term->second : 0;
+    }
+
+    IntcodePolynomial operator+(const IntcodePolynomial& other) const
+    {
+        IntcodePolynomial sum = *this;
+        for (auto& term : other._terms) {
+            sum.addTerm(term.first, term.second);
+        }
+        return sum;
+    }
+
+    IntcodePolynomial operator-(const IntcodePolynomial& other) const
+    {
+        return *this + other * IntcodePolynomial(-1);
+    }
+
+    IntcodePolynomial operator*(const IntcodePolynomial& other) const
+    {
+        IntcodePolynomial product;
+        for (auto& a : _terms)
+        for (auto& b : other._terms)
+        {
+            Monomial m;
+            std::merge(a.first.begin(), a.first.end(), b.first.begin(), b.first.end(), std::back_inserter(m));
+            product.addTerm(m, wrap((unsigned long long) a.second * (unsigned long long) b.second));
+        }
+        return product;
+    }
+
+    bool operator==(const IntcodePolynomial& other) const { return _terms == other._terms; }
+
+    const std::map<Monomial, long long>& terms() const { return _terms; }
+
+    // Every cell has to be given a value
+    long long evaluate(const std::map<long long, long long>& values) const
+    {
+        unsigned long long sum = 0;
+        for (auto& term : _terms)
+        {
+            unsigned long long product = term.second;
+            for (long long address : term.first) {
+                product *= (unsigned long long) values.at(address);
+            }
+            sum += product;
+        }
+        return wrap(sum);
+    }
+
+    // Highest power of the cell over all terms
+    int degree(long long address) const
+    {
+        int degree = 0;
+        for (auto& term : _terms) {
+            degree = std::max<int>(degree, std::count(term.first.begin(), term.first.end(), address));
+        }
+        return degree;
+    }
+
+    std::string toString() const
+    {
+        if (_terms.empty()) {
+            return "0";
+        }
+
+        // Constant term last
+        std::string text;
+        for (auto term = _terms.rbegin(); term != _terms.rend(); ++term)
+        {
+            std::string factors;
+            for (long long address : term->first) {
+                factors += (factors.empty() ? "[" : "*[") + std::to_string(address) + "]";
+            }
+            if (!text.empty()) {
+                text += " + ";
+            }
+            if (factors.empty() || term->second != 1) {
+                text += std::to_string(term->second) + (factors.empty() ? "" : "*");
+            }
+            text += factors;
+        }
+        return text;
+    }
+
+private:
+
+    static long long wrap(unsigned long long value) { return (long long) value; }
+
+    void addTerm(const Monomial& monomial, long long coefficient)
+    {
+        long long& c = _terms[monomial];
+        c = wrap((unsigned long long) c + (unsigned long long) coefficient);
+        if (c == 0) {
+            _terms.erase(monomial);
+        }
+    }
+
+    std::map<Monomial, long long> _terms;
+};
+
+// Runs an input-free program over memory where some cells are unknowns and
+// derives every cell as a polynomial of them. A read through an address
+// depending on the unknowns leaves its result unresolved, which is fine as
+// long as the program overwrites it. An opcode, a write address, a jump or an
+// output depending on the unknowns (or on an unresolved cell) stops the run
+// and getFailure() says where. Whatever the run derives then holds for every
+// value of the unknowns.
+class IntcodeSymbolic : private IntcodeInstructionSet
+{
+public:
+    static const unsigned long long DEFAULT_STEP_LIMIT = 1000000;
+    static const long long MAX_CELLS = 1 << 20;
+
+    IntcodeSymbolic(const std::vector<long long>& image, const std::vector<long long>& unknowns)
+        :_memory(image.begin(), image.end())
+    {
+        for (long long address : unknowns) {
+            cellAt(address) = IntcodePolynomial::cell(address);
+        }
+    }
+
+    // True once the program halted, false if it is not amenable
+    bool run(unsigned long long stepLimit = DEFAULT_STEP_LIMIT)
+    {
+        try
+        {
+            for (unsigned long long steps = 0; ; steps++)
+            {
+                if (steps == stepLimit) {
+                    throw NotAmenable("no HALT within " + std::to_string(stepLimit) + " instructions");
+                }
+                if (!step()) {
+                    return true;
+                }
+            }
+        }
+        catch (const NotAmenable& e)
+        {
+            _failure = e.what();
+            return false;
+        }
+    }
+
+    const std::string& getFailure() { return _failure; }
+
+    bool isResolved(long long address) { return _unresolved.find(address) == _unresolved.end(); }
+
+    // Why the cell has no closed form, empty if it has one
+    std::string whyUnresolved(long long address)
+    {
+        auto reason = _unresolved.find(address);
+        return reason != _unresolved.end() ? reason->second : std::string();
+    }
+
+    IntcodePolynomial value(long long address)
+    {
+        if (!isResolved(address)) {
+            throw std::runtime_error("Cell " + std::to_string(address) + " has no closed form: " + whyUnresolved(address));
+        }
+        return address >= 0 && address < (long long) _memory.size() ? _memory[address] : IntcodePolynomial();
+    }
+
+    const std::vector<IntcodePolynomial>& getOutputs() { return _outputs; }
+
+    struct Range
+    {
+        long long address;
+        long long first, last;  // Inclusive
+    };
+
+    // Values of the unknowns within their ranges for which p equals target,
+    // the first one counting the ranges like nested loops, outermost first
+    static std::optional< std::map<long long, long long> > solve(const IntcodePolynomial& p, long long target,
+        const std::vector<Range>& ranges)
+    {
+        if (ranges.empty()) {
+            return std::nullopt;
+        }
+
+        // The innermost unknown is solved for when p is linear in it, the rest is enumerated
+        const Range& inner = ranges.back();
+        const bool linear = p.degree(inner.address) <= 1;
+        std::vector<Range> outer(ranges.begin(), ranges.end() - (linear ? 1 : 0));
+
+        std::map<long long, long long> values;
+        for (auto& range : outer)
+        {
+            if (range.first > range.last) {
+                return std::nullopt;
+            }
+            values[range.address] = range.first;
+        }
+
+        while (true)
+        {
+            if (!linear)
+            {
+                if (p.evaluate(values) == target) {
+                    return values;
+                }
+            }
+            else if (solveLinear(p, target, inner, values)) {
+                return values;
+            }
+
+            // Next assignment of the enumerated unknowns
+            int i = (int) outer.size() - 1;
+            for (; i >= 0; i--)
+            {
+                if (values[outer[i].address]++ < outer[i].last) {
+                    break;
+                }
+                values[outer[i].address] = outer[i].first;
+            }
+            if (i < 0) {
+                return std::nullopt;
+            }
+        }
+    }
+
+private:
+
+    struct NotAmenable : std::runtime_error
+    {
+        explicit NotAmenable(const std::string& what) : std::runtime_error(what) { }
+    };
+
+    // p = a * x + b with the other unknowns fixed, x is added to values when it fits
+    static bool solveLinear(const IntcodePolynomial& p, long long target, const Range& x,
+        std::map<long long, long long>& values)
+    {
+        unsigned long long a = 0, b = 0;
+        for (auto& term : p.terms())
+        {
+            unsigned long long product = term.second;
+            bool hasX = false;
+            for (long long address : term.first)
+            {
+                if (address == x.address) {
+                    hasX = true;
+                }
+                else {
+                    product *= (unsigned long long) values.at(address);
+                }
+            }
+            (hasX ? a : b) += product;
+        }
+
+        // a * x = rest modulo 2^64. With a = 2^shift * odd the solutions are
+        // rest / 2^shift * odd^-1 modulo 2^(64 - shift), the smallest one in
+        // the range is taken.
+        if (x.first > x.last) {
+            return false;
+        }
+        const unsigned long long rest = (unsigned long long) target - b;
+        long long candidate;
+        if (a == 0)
+        {
+            if (rest != 0) {
+                return false;
+            }
+            candidate = x.first;
+        }
+        else
+        {
+            const int shift = __builtin_ctzll(a);
+            const unsigned long long mask = ~0ULL >> shift;
+            if ((rest & ~(~0ULL << shift)) != 0) {
+                return false;
+            }
+            const unsigned long long solution = (rest >> shift) * inverse(a >> shift) & mask;
+            const unsigned long long offset = (solution - (unsigned long long) x.first) & mask;
+            if (offset > (unsigned long long) x.last - (unsigned long long) x.first) {
+                return false;
+            }
+            candidate = (long long) ((unsigned long long) x.first + offset);
+        }
+
+        // Checked with the wrapping arithmetic of the VM
+        values[x.address] = candidate;
+        if (p.evaluate(values) != target)
+        {
+            values.erase(x.address);
+            return false;
+        }
+        return true;
+    }
+
+    // Inverse of an odd number modulo 2^64, each Newton step doubles the correct bits
+    static unsigned long long inverse(unsigned long long odd)
+    {
+        unsigned long long result = odd;
+        for (int i = 0; i < 5; i++) {
+            result *= 2 - odd * result;
+        }
+        return result;
+    }
+
+    // Cell value, or why it is not known
+    struct Value
+    {
+        IntcodePolynomial p;
+        std::string unresolved;
+    };
+
+    IntcodePolynomial& cellAt(long long address)
+    {
+        if (address < 0 || address >= MAX_CELLS) {
+            throw NotAmenable("address " + std::to_string(address) + " is outside of memory");
+        }
+        if (address >= (long long) _memory.size()) {
+            _memory.resize(address + 1);
+        }
+        return _memory[address];
+    }
+
+    long long concrete(long long address, const char* what)
+    {
+        if (!isResolved(address)) {
+            throw NotAmenable(std::string(what) + " at " + std::to_string(_ip) + " is unknown, " + whyUnresolved(address));
+        }
+        const IntcodePolynomial& cell = cellAt(address);
+        if (!cell.isConstant()) {
+            throw NotAmenable(std::string(what) + " at " + std::to_string(_ip) + " depends on " + cell.toString());
+        }
+        return cell.constant();
+    }
+
+    long long operandAddress(const DecodedInstruction& instr, int i)
+    {
+        switch (instr.modes[i])
+        {
+            case POSITION_MODE:
+                return concrete(_ip + 1 + i, "address");
+
+            case IMMEDIATE_MODE:
+                return _ip + 1 + i;
+
+            default:
+                return _relativeBase + concrete(_ip + 1 + i, "relative address");
+        };
+    }
+
+    Value read(const DecodedInstruction& instr, int i)
+    {
+        const long long pointer = _ip + 1 + i;
+        if (instr.modes[i] != IMMEDIATE_MODE && (!isResolved(pointer) || !cellAt(pointer).isConstant())) {
+            return Value {0, "read at " + std::to_string(_ip) + " through an unknown address"};
+        }
+        const long long address = operandAddress(instr, i);
+        if (!isResolved(address)) {
+            return Value {0, whyUnresolved(address)};
+        }
+        return Value {cellAt(address), ""};
+    }
+
+    void write(long long address, const Value& value)
+    {
+        cellAt(address) = value.p;
+        if (value.unresolved.empty()) {
+            _unresolved.erase(address);
+        }
+        else {
+            _unresolved[address] = value.unresolved;
+        }
+    }
+
+    // EQUALS is decided when the operands differ by a constant. LESS_THAN only
+    // for two constants, either side may have wrapped around.
+    Value compare(int opCode, const IntcodePolynomial& a, const IntcodePolynomial& b)
+    {
+        if (opCode == LESS_THAN)
+        {
+            if (!a.isConstant() || !b.isConstant()) {
+                return Value {0, "comparison at " + std::to_string(_ip) + " depends on " + (a - b).toString()};
+            }
+            return Value {a.constant() < b.constant() ? 1 : 0, ""};
+        }
+
+        const IntcodePolynomial difference = a - b;
+        if (!difference.isConstant()) {
+            return Value {0, "comparison at " + std::to_string(_ip) + " depends on " + difference.toString()};
+        }
+        return Value {difference.constant() == 0 ? 1 : 0, ""};
+    }
+
+    // False once the program halted
+    bool step()
+    {
+        // Running past the last cell ends the program like a HALT
+        if (_ip >= (long long) _memory.size()) {
+            return false;
+        }
+
+        DecodedInstruction instr;
+        const long long word = concrete(_ip, "opcode");
+        if (!decodeWord(word, instr)) {
+            throw NotAmenable("unknown opcode " + std::to_string(word) + " at " + std::to_string(_ip));
+        }
+
+        switch (instr.opCode)
+        {
+            case ADD: case MULT: case LESS_THAN: case EQUALS:
+            {
+                const Value a = read(instr, 0), b = read(instr, 1);
+                const long long target = operandAddress(instr, 2);
+                if (!a.unresolved.empty() || !b.unresolved.empty())
+                {
+                    write(target, Value {0, !a.unresolved.empty() ? a.unresolved : b.unresolved});
+                    break;
+                }
+                if (instr.opCode == ADD || instr.opCode == MULT) {
+                    write(target, Value {instr.opCode == ADD ? a.p + b.p : a.p * b.p, ""});
+                }
+                else {
+                    write(target, compare(instr.opCode, a.p, b.p));
+                }
+                break;
+            }
+
+            case JUMP_IF_TRUE: case JUMP_IF_FALSE:
+            {
+                const long long condition = concrete(operandAddress(instr, 0), "jump condition"),
+                    target = concrete(operandAddress(instr, 1), "jump target");
+                if ((condition != 0) == (instr.opCode == JUMP_IF_TRUE))
+                {
+                    _ip = target;
+                    return true;
+                }
+                break;
+            }
+
+            case BASE_OP:
+                _relativeBase += concrete(operandAddress(instr, 0), "relative base");
+                break;
+
+            case INPUT:
+                throw NotAmenable("INPUT at " + std::to_string(_ip));
+
+            case OUTPUT:
+            {
+                const Value value = read(instr, 0);
+                if (!value.unresolved.empty()) {
+                    throw NotAmenable("output at " + std::to_string(_ip) + " is unknown, " + value.unresolved);
+                }
+                _outputs.push_back(value.p);
+                break;
+            }
+
+            default:
+                return false;
+        };
+
+        _ip += instr.length;
+        return true;
+    }
+
+    std::vector<IntcodePolynomial> _memory;
+    std::map<long long, std::string> _unresolved;  // Cells without a closed form and why
+    std::vector<IntcodePolynomial> _outputs;
+    long long _ip = 0;
+    long long _relativeBase = 0;
+    std::string _failure;
+};
+
+#endif /* INTCODE_SYMBOLIC_HPP */
@@ -0,0 +1,820 @@
+#ifndef INTCODE_TRACE_HPP
+#define INTCODE_TRACE_HPP
+
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <exception>
+#include <algorithm>
+#include <iterator>
+#include "intcode_instruction_set.hpp"
+
+// Binary execution trace of an IntcodeComputer (built with INTCODE_TRACE).
+//
+// File layout, integers are LEB128 varints, signed ones zigzag encoded:
+//   header      "ICTR", version, checkpoint interval, image size, image cells
+//   records     one per executed instruction (STEP), plus RESET / POKE for
+//               state changes made between runs and periodic CHECKPOINTs
+//   END         final ip and relative base, step count, checkpoint index
+//               (step, file offset) pairs
+//   trailer     offset of END as 8 little endian bytes, "ICTE"
+//
+// A STEP record is a byte holding the record kind and flags for what follows:
+// the ip when it is not the one after the previous instruction, the written
+// cell (address relative to ip, value relative to what the cell held), the
+// relative base change, the input consumed and the output produced. A
+// CHECKPOINT holds the whole state, every cell that differs from the image.
+//
+// "State at step n" is the VM just before it executes instruction n + 1,
+// all writes between runs included.
+struct IntcodeTraceFormat
+{
+    enum Record
+    {
+        STEP        = 0,
+        CHECKPOINT  = 1,
+        RESET       = 2,    // Memory back to the image, ip and relative base follow
+        POKE        = 3,    // Write from outside of the program
+        END         = 4
+    };
+
+    enum StepFlags
+    {
+        STEP_JUMPED = 1 << 3,
+        STEP_WRITE  = 1 << 4,
+        STEP_BASE   = 1 << 5,
+        STEP_INPUT  = 1 << 6,
+        STEP_OUTPUT = 1 << 7
+    };
+
+    static const unsigned VERSION = 1;
+
+    static unsigned long long zigzag(long long value)
+    {
+        return ((unsigned long long) value << 1) ^ (unsigned long long) (value >> 63);
+    }
+
+    static long long unzigzag(unsigned long long value)
+    {
+        return (long long) (value >> 1) ^ -(long long) (value & 1);
+    }
+
+    // Memory rebuilt from the trace. Low addresses are kept flat, the few
+    // cells far above them in a map.
+    class Memory
+    {
+    public:
+        static const long long DENSE_LIMIT = 1 << 22;
+
+        explicit Memory(std::shared_ptr<const std::vector<long long>> image)
+            :_image(image), _dense(*image)
+        { }
+
+        long long get(long long address) const
+        {
+            if ((unsigned long long) address < _dense.size()) {
+                return _dense[address];
+            }
+            auto cell = _far.find(address);
+            return cell != _far.end() ? cell->second : 0;
+        }
+
+        void set(long long address, long long value)
+        {
+            if (address < 0) {
+                throw std::runtime_error("Trace writes negative address " + std::to_string(address));
+            }
+            if (address < DENSE_LIMIT)
+            {
+                if (address >= (long long) _dense.size()) {
+                    _dense.resize(std::min(DENSE_LIMIT, std::max(address + 1, 2 * (long long) _dense.size())), 0);
+                }
+                _dense[address] = value;
+            }
+            else if (value == 0) {
+                _far.erase(address);
+            }
+            else {
+                _far[address] = value;
+            }
+        }
+
+        // Back to the image
+        void clear()
+        {
+            _dense.assign(_image->begin(), _image->end());
+            _far.clear();
+        }
+
+        // Cells that differ from the image, by address
+        std::vector< std::pair<long long, long long> > changed() const
+        {
+            std::vector< std::pair<long long, long long> > cells;
+            for (long long address = 0; address < (long long) _dense.size(); address++)
+            {
+                const long long pristine = address < (long long) _image->size() ? (*_image)[address] : 0;
+                if (_dense[address] != pristine) {
+                    cells.emplace_back(address, _dense[address]);
+                }
+            }
+            const size_t dense = cells.size();
+            cells.insert(cells.end(), _far.begin(), _far.end());
+            std::sort(cells.begin() + dense, cells.end());
+            return cells;
+        }
+
+    private:
+        std::shared_ptr<const std::vector<long long>> _image;
+        std::vector<long long> _dense;
+        std::unordered_map<long long, long long> _far;
+    };
+};
+
+// Receives the events of one VM. The VM thread only appends fixed size events
+// to a chunk, a background thread encodes full chunks and writes them out.
+class IntcodeTraceRecorder : private IntcodeTraceFormat
+{
+public:
+    static const unsigned long long DEFAULT_CHECKPOINT_INTERVAL = 1 << 16;    // Steps
+
+    struct Stats
+    {
+        unsigned long long steps = 0;
+        unsigned long long checkpoints = 0;
+        unsigned long long bytes = 0;
+    };
+
+    explicit IntcodeTraceRecorder(const std::string& fileName,
+        unsigned long long checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL)
+        :_file(fileName, std::ios::binary), _checkpointInterval(std::max(1ULL, checkpointInterval))
+    {
+        if (!_file) {
+            throw std::runtime_error("Unable to open trace file " + fileName);
+        }
+        _chunk.reserve(CHUNK_EVENTS);
+        _writer = std::thread(&IntcodeTraceRecorder::writerLoop, this);
+    }
+
+    IntcodeTraceRecorder(const IntcodeTraceRecorder&) = delete;
+    IntcodeTraceRecorder& operator=(const IntcodeTraceRecorder&) = delete;
+
+    // Errors of the writer are lost unless close() was called first
+    ~IntcodeTraceRecorder()
+    {
+        try {
+            close();
+        }
+        catch (...) { }
+    }
+
+    // Writes the rest of the trace and the index, the recorder takes no more
+    // events. Rethrows what stopped the writer thread, if anything did.
+    Stats close()
+    {
+        if (_writer.joinable())
+        {
+            push(CLOSE, 0, 0);
+            if (!_chunk.empty()) {
+                handOff();
+            }
+            _writer.join();
+            if (_error != nullptr) {
+                std::rethrow_exception(_error);
+            }
+        }
+        return _stats;
+    }
+
+    // Called by IntcodeComputer
+    void start(const std::vector<long long>& image) { _image = std::make_shared<const std::vector<long long>>(image); }
+    void step(long long ip) { push(STEP_EVENT, ip, 0); }
+    void retract() { push(RETRACT, 0, 0); }
+    void write(long long address, long long value) { push(WRITE_EVENT, address, value); }
+    void base(long long relativeBase) { push(BASE_EVENT, relativeBase, 0); }
+    void input(long long value) { push(INPUT_EVENT, value, 0); }
+    void output(long long value) { push(OUTPUT_EVENT, value, 0); }
+    void stop(long long ip, long long relativeBase) { push(STOP, ip, relativeBase); }
+    void reset(long long ip, long long relativeBase) { push(RESET_EVENT, ip, relativeBase); }
+
+private:
+
+    enum EventKind
+    {
+        STEP_EVENT, RETRACT, WRITE_EVENT, BASE_EVENT, INPUT_EVENT, OUTPUT_EVENT, STOP, RESET_EVENT, CLOSE
+    };
+
+    struct Event
+    {
+        int kind;
+        long long a, b;
+    };
+
+    static const size_t CHUNK_EVENTS = 1 << 12;
+    static const size_t MAX_QUEUED_CHUNKS = 64;
+
+    void push(int kind, long long a, long long b)
+    {
+        _chunk.push_back(Event {kind, a, b});
+        if (_chunk.size() == CHUNK_EVENTS) {
+            handOff();
+        }
+    }
+
+    // Queues the chunk for the writer, waits while the writer is far behind
+    void handOff()
+    {
+        std::vector<Event> next;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _drained.wait(lock, [this] { return _queue.size() < MAX_QUEUED_CHUNKS; });
+            _queue.push_back(std::move(_chunk));
+            if (!_spare.empty())
+            {
+                next = std::move(_spare.back());
+                _spare.pop_back();
+            }
+        }
+        _ready.notify_one();
+        _chunk = std::move(next);
+        _chunk.clear();
+        _chunk.reserve(CHUNK_EVENTS);
+    }
+
+    // Background thread. After an error the remaining chunks are only
+    // drained, so the VM thread never waits on a writer that stopped.
+    void writerLoop()
+    {
+        bool closing = false;
+        while (!closing)
+        {
+            std::vector<Event> chunk;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _ready.wait(lock, [this] { return !_queue.empty(); });
+                chunk = std::move(_queue.front());
+                _queue.pop_front();
+            }
+            _drained.notify_one();
+
+            // CLOSE is the last event the VM thread hands off
+            closing = chunk.back().kind == CLOSE;
+            guarded([&]
+            {
+                for (const Event& event : chunk)
+                {
+                    if (event.kind != CLOSE) {
+                        encode(event);
+                    }
+                }
+                flushBuffer();
+            });
+
+            chunk.clear();
+            std::lock_guard<std::mutex> lock(_mutex);
+            _spare.push_back(std::move(chunk));
+        }
+
+        guarded([this]
+        {
+            flushStep();
+            finish();
+            flushBuffer();
+            _file.flush();
+        });
+    }
+
+    // Keeps the first exception for close(), nothing runs after it
+    template <typename Work>
+    void guarded(Work work)
+    {
+        if (_error != nullptr) {
+            return;
+        }
+        try {
+            work();
+        }
+        catch (...) {
+            _error = std::current_exception();
+        }
+    }
+
+    struct PendingStep
+    {
+        long long ip = 0;
+        int flags = 0;
+        long long address = 0, value = 0, relativeBase = 0, input = 0, output = 0;
+    };
+
+    void encode(const Event& event)
+    {
+        if (_memory == nullptr) {
+            header();
+        }
+
+        switch (event.kind)
+        {
+            case STEP_EVENT:
+                flushStep();
+                _pending.ip = event.a;
+                _hasPending = true;
+                break;
+
+            case RETRACT:
+                _hasPending = false;
+                _pending = PendingStep();
+                break;
+
+            case WRITE_EVENT:
+                if (_hasPending && !(_pending.flags & STEP_WRITE))
+                {
+                    _pending.flags |= STEP_WRITE;
+                    _pending.address = event.a;
+                    _pending.value = event.b;
+                }
+                else
+                {
+                    flushStep();
+                    poke(event.a, event.b);
+                }
+                break;
+
+            case BASE_EVENT:
+                if (!_hasPending) {
+                    throw std::logic_error("Relative base changed outside of an instruction");
+                }
+                _pending.flags |= STEP_BASE;
+                _pending.relativeBase = event.a;
+                break;
+
+            case INPUT_EVENT:
+                _pending.flags |= STEP_INPUT;
+                _pending.input = event.a;
+                break;
+
+            case OUTPUT_EVENT:
+                _pending.flags |= STEP_OUTPUT;
+                _pending.output = event.a;
+                break;
+
+            case STOP:
+                flushStep();
+                _ip = event.a;
+                _relativeBase = event.b;
+                break;
+
+            default:
+                flushStep();
+                _ip = _expectedIp = event.a;
+                _relativeBase = event.b;
+                _memory->clear();
+                _buffer.push_back(RESET);
+                putSigned(event.a);
+                putSigned(event.b);
+                break;
+        };
+    }
+
+    void header()
+    {
+        if (_image == nullptr) {
+            throw std::logic_error("Trace recorder was not started by a computer");
+        }
+        _memory.reset(new Memory(_image));
+        _buffer.insert(_buffer.end(), {'I', 'C', 'T', 'R'});
+        put(VERSION);
+        put(_checkpointInterval);
+        put(_image->size());
+        for (long long cell : *_image) {
+            putSigned(cell);
+        }
+    }
+
+    void poke(long long address, long long value)
+    {
+        _buffer.push_back(POKE);
+        put(address);
+        putSigned(value - _memory->get(address));
+        _memory->set(address, value);
+    }
+
+    void flushStep()
+    {
+        if (!_hasPending) {
+            return;
+        }
+        _hasPending = false;
+        PendingStep step = _pending;
+        _pending = PendingStep();
+
+        if (_stats.steps > 0 && _stats.steps % _checkpointInterval == 0 && _stats.steps != _lastCheckpoint) {
+            checkpoint(step.ip);
+        }
+
+        int flags = step.flags;
+        if (step.ip != _expectedIp) {
+            flags |= STEP_JUMPED;
+        }
+        _buffer.push_back(STEP | flags);
+        if (flags & STEP_JUMPED) {
+            putSigned(step.ip - _expectedIp);
+        }
+
+        // Length of the instruction as it was before its own write
+        const int length = IntcodeInstructionSet::instructionLength(_memory->get(step.ip) % 100);
+        if (flags & STEP_WRITE)
+        {
+            putSigned(step.address - step.ip);
+            putSigned(step.value - _memory->get(step.address));
+            _memory->set(step.address, step.value);
+        }
+        if (flags & STEP_BASE)
+        {
+            putSigned(step.relativeBase - _relativeBase);
+            _relativeBase = step.relativeBase;
+        }
+        if (flags & STEP_INPUT) {
+            putSigned(step.input);
+        }
+        if (flags & STEP_OUTPUT) {
+            putSigned(step.output);
+        }
+
+        _expectedIp = step.ip + std::max(length, 1);
+        _stats.steps++;
+    }
+
+    void checkpoint(long long ip)
+    {
+        _lastCheckpoint = _stats.steps;
+        _index.emplace_back(_stats.steps, _offset + _buffer.size());
+        _stats.checkpoints++;
+
+        const auto cells = _memory->changed();
+        _buffer.push_back(CHECKPOINT);
+        put(_stats.steps);
+        putSigned(ip);
+        putSigned(_relativeBase);
+        put(cells.size());
+        long long previous = 0;
+        for (auto& cell : cells)
+        {
+            put(cell.first - previous);
+            putSigned(cell.second);
+            previous = cell.first;
+        }
+        _expectedIp = ip;
+    }
+
+    void finish()
+    {
+        // Closed before a computer started it, a trace of no steps over an empty image
+        if (_memory == nullptr && _image == nullptr) {
+            _image = std::make_shared<const std::vector<long long>>();
+        }
+        if (_memory == nullptr) {
+            header();
+        }
+        const unsigned long long end = _offset + _buffer.size();
+        _buffer.push_back(END);
+        putSigned(_ip);
+        putSigned(_relativeBase);
+        put(_stats.steps);
+        put(_index.size());
+        for (auto& entry : _index)
+        {
+            put(entry.first);
+            put(entry.second);
+        }
+        for (int i = 0; i < 8; i++) {
+            _buffer.push_back((end >> (8 * i)) & 0xff);
+        }
+        _buffer.insert(_buffer.end(), {'I', 'C', 'T', 'E'});
+    }
+
+    void put(unsigned long long value)
+    {
+        while (value >= 0x80)
+        {
+            _buffer.push_back((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        _buffer.push_back(value);
+    }
+
+    void putSigned(long long value) { put(zigzag(value)); }
+
+    void flushBuffer()
+    {
+        _file.write(reinterpret_cast<const char*>(_buffer.data()), _buffer.size());
+        _offset += _buffer.size();
+        _stats.bytes = _offset;
+        _buffer.clear();
+    }
+
+    // VM thread
+    std::vector<Event> _chunk;
+
+    // Shared
+    std::mutex _mutex;
+    std::condition_variable _ready, _drained;
+    std::deque< std::vector<Event> > _queue;
+    std::vector< std::vector<Event> > _spare;
+    std::shared_ptr<const std::vector<long long>> _image;   // Set before the first event
+    std::thread _writer;
+
+    // Writer thread
+    std::ofstream _file;
+    unsigned long long _checkpointInterval;
+    std::unique_ptr<Memory> _memory;
+    std::vector<unsigned char> _buffer;
+    unsigned long long _offset = 0;
+    PendingStep _pending;
+    bool _hasPending = false;
+    long long _ip = 0, _expectedIp = 0, _relativeBase = 0;
+    unsigned long long _lastCheckpoint = 0;
+    std::vector< std::pair<unsigned long long, unsigned long long> > _index;   // (step, offset) of the checkpoints
+    Stats _stats;
+    std::exception_ptr _error;      // Read by close() once the writer joined
+};
+
+// Reads a trace back and rebuilds the VM state at any step
+class IntcodeTraceReader : private IntcodeTraceFormat
+{
+public:
+
+    struct State
+    {
+        unsigned long long step = 0;
+        long long instructionPointer = 0;
+        long long relativeBase = 0;
+        Memory memory;
+    };
+
+    explicit IntcodeTraceReader(const std::string& fileName)
+    {
+        std::ifstream file(fileName, std::ios::binary);
+        _data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (_data.size() < 4 || std::string(_data.begin(), _data.begin() + 4) != "ICTR") {
+            throw std::runtime_error(fileName + " is not an Intcode trace");
+        }
+
+        size_t position = 4;
+        if (get(position) != VERSION) {
+            throw std::runtime_error("Unsupported trace version in " + fileName);
+        }
+        _checkpointInterval = get(position);
+        std::vector<long long> image(get(position));
+        for (long long& cell : image) {
+            cell = getSigned(position);
+        }
+        _image = std::make_shared<const std::vector<long long>>(std::move(image));
+        _records = position;
+        readEnd();
+    }
+
+    unsigned long long steps() { return _steps; }
+    const std::vector<long long>& image() { return *_image; }
+
+    // Replays from the last checkpoint at or before the step
+    State stateAt(unsigned long long step)
+    {
+        if (step > _steps) {
+            throw std::out_of_range("Trace has " + std::to_string(_steps) + " steps, not " + std::to_string(step));
+        }
+
+        State state {0, 0, 0, Memory(_image)};
+        size_t position = _records;
+        auto checkpoint = std::upper_bound(_index.begin(), _index.end(), std::make_pair(step, ~0ULL));
+        if (checkpoint != _index.begin()) {
+            position = (checkpoint - 1)->second;
+        }
+
+        long long expectedIp = 0;
+        while (true)
+        {
+            const unsigned char record = _data.at(position);
+            const int kind = record & 7;
+            if (kind == STEP && state.step == step)
+            {
+                // The ip of the next instruction is the one this step starts at
+                size_t peek = position + 1;
+                state.instructionPointer = (record & STEP_JUMPED) ? expectedIp + getSigned(peek) : expectedIp;
+                return state;
+            }
+            position++;
+
+            switch (kind)
+            {
+                case STEP:
+                {
+                    const long long ip = (record & STEP_JUMPED) ? expectedIp + getSigned(position) : expectedIp;
+                    const int length = IntcodeInstructionSet::instructionLength(state.memory.get(ip) % 100);
+                    if (record & STEP_WRITE)
+                    {
+                        const long long address = ip + getSigned(position);
+                        state.memory.set(address, state.memory.get(address) + getSigned(position));
+                    }
+                    if (record & STEP_BASE) {
+                        state.relativeBase += getSigned(position);
+                    }
+                    if (record & STEP_INPUT) {
+                        getSigned(position);
+                    }
+                    if (record & STEP_OUTPUT) {
+                        getSigned(position);
+                    }
+                    expectedIp = ip + std::max(length, 1);
+                    state.step++;
+                    break;
+                }
+
+                case CHECKPOINT:
+                {
+                    state.step = get(position);
+                    expectedIp = getSigned(position);
+                    state.relativeBase = getSigned(position);
+                    state.memory.clear();
+                    const unsigned long long cells = get(position);
+                    long long address = 0;
+                    for (unsigned long long i = 0; i < cells; i++)
+                    {
+                        address += get(position);
+                        state.memory.set(address, getSigned(position));
+                    }
+                    break;
+                }
+
+                case RESET:
+                    state.memory.clear();
+                    expectedIp = getSigned(position);
+                    state.relativeBase = getSigned(position);
+                    break;
+
+                case POKE:
+                {
+                    const long long address = get(position);
+                    state.memory.set(address, state.memory.get(address) + getSigned(position));
+                    break;
+                }
+
+                case END:
+                {
+                    state.instructionPointer = getSigned(position);
+                    state.relativeBase = getSigned(position);
+                    return state;
+                }
+
+                default:
+                    throw std::runtime_error("Corrupt trace record at offset " + std::to_string(position - 1));
+            };
+        }
+    }
+
+    // Every output with the step that produced it (1 based, like the state after it)
+    std::vector< std::pair<unsigned long long, long long> > outputs()
+    {
+        std::vector< std::pair<unsigned long long, long long> > values;
+        forEachStep([&values](unsigned long long step, int record, long long, long long output)
+        {
+            if (record & STEP_OUTPUT) {
+                values.emplace_back(step, output);
+            }
+        });
+        return values;
+    }
+
+    // Every input consumed with the step that consumed it
+    std::vector< std::pair<unsigned long long, long long> > inputs()
+    {
+        std::vector< std::pair<unsigned long long, long long> > values;
+        forEachStep([&values](unsigned long long step, int record, long long input, long long)
+        {
+            if (record & STEP_INPUT) {
+                values.emplace_back(step, input);
+            }
+        });
+        return values;
+    }
+
+private:
+
+    unsigned long long get(size_t& position)
+    {
+        unsigned long long value = 0;
+        for (int shift = 0; ; shift += 7)
+        {
+            const unsigned char byte = _data.at(position++);
+            value |= (unsigned long long) (byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+    }
+
+    long long getSigned(size_t& position) { return unzigzag(get(position)); }
+
+    void readEnd()
+    {
+        const size_t size = _data.size();
+        if (size < _records + 12 || std::string(_data.end() - 4, _data.end()) != "ICTE") {
+            throw std::runtime_error("Trace is incomplete, the recorder was not closed");
+        }
+        size_t position = 0;
+        for (int i = 0; i < 8; i++) {
+            position |= (size_t) _data[size - 12 + i] << (8 * i);
+        }
+        if (_data.at(position++) != END) {
+            throw std::runtime_error("Trace index is corrupt");
+        }
+        getSigned(position);
+        getSigned(position);
+        _steps = get(position);
+        _index.resize(get(position));
+        for (auto& entry : _index)
+        {
+            entry.first = get(position);
+            entry.second = get(position);
+        }
+    }
+
+    // Walks the step records only, memory is not rebuilt
+    template <typename Visit>
+    void forEachStep(Visit visit)
+    {
+        size_t position = _records;
+        unsigned long long step = 0;
+        while (true)
+        {
+            const unsigned char record = _data.at(position++);
+            switch (record & 7)
+            {
+                case STEP:
+                {
+                    long long input = 0, output = 0;
+                    if (record & STEP_JUMPED) {
+                        getSigned(position);
+                    }
+                    if (record & STEP_WRITE)
+                    {
+                        getSigned(position);
+                        getSigned(position);
+                    }
+                    if (record & STEP_BASE) {
+                        getSigned(position);
+                    }
+                    if (record & STEP_INPUT) {
+                        input = getSigned(position);
+                    }
+                    if (record & STEP_OUTPUT) {
+                        output = getSigned(position);
+                    }
+                    visit(++step, record, input, output);
+                    break;
+                }
+
+                case CHECKPOINT:
+                {
+                    get(position);
+                    getSigned(position);
+                    getSigned(position);
+                    const unsigned long long cells = get(position);
+                    for (unsigned long long i = 0; i < cells; i++)
+                    {
+                        get(position);
+                        getSigned(position);
+                    }
+                    break;
+                }
+
+                case RESET:
+                    getSigned(position);
+                    getSigned(position);
+                    break;
+
+                case POKE:
+                    get(position);
+                    getSigned(position);
+                    break;
+
+                default:
+                    return;
+            };
+        }
+    }
+
+    std::vector<unsigned char> _data;
+    std::shared_ptr<const std::vector<long long>> _image;
+    size_t _records = 0;                // Offset of the first record
+    unsigned long long _checkpointInterval = 0;
+    unsigned long long _steps = 0;
+    std::vector< std::pair<unsigned long long, unsigned long long> > _index;
+};
+
+#endif /* INTCODE_TRACE_HPP */
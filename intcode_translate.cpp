@@ -0,0 +1,320 @@
+#include "intcode_instruction_set.hpp"
+#include "intcode_disassembler.hpp"
+#include "intcode_loader.hpp"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <climits>
+#include <cstdio>
+#include <cctype>
+
+// Translates an Intcode program into a C++ header implementing it as one
+// function with a case per instruction, to be handed to
+// IntcodeComputer::setNativeProgram. Only the code IntcodeDisassembler
+// reaches is translated, a basic block at a time: a store that changes one
+// of its cells switches off that block alone, the rest keeps running native.
+//
+//   intcode_translate day13.txt day13_native.hpp [name]
+class IntcodeTranslator : private IntcodeInstructionSet
+{
+public:
+    IntcodeTranslator(std::vector<long long> image, std::string name)
+        :_image(image), _name(name), _codeMask(image.size(), 0), _blockOf(image.size(), -1)
+    {
+        collect();
+    }
+
+    void write(std::ostream& out)
+    {
+        out << "// Generated by intcode_translate, do not edit\n";
+        out << "#ifndef " << guard() << "\n#define " << guard() << "\n\n";
+        out << "#include \"intcode_native_program.hpp\"\n\n";
+        out << "#pragma GCC diagnostic push\n";
+        out << "#pragma GCC diagnostic ignored \"-Wunused-label\"\n";
+        out << "#pragma GCC diagnostic ignored \"-Wtautological-compare\"\n\n";
+
+        out << "static const long long " << _name << "_image[] = {";
+        for (size_t i = 0; i < _image.size(); i++) out << (i % 16 ? " " : "\n    ") << literal(_image[i]) << ",";
+        out << "\n};\n\n";
+
+        out << "static const unsigned char " << _name << "_codeMask[] = {";
+        for (size_t i = 0; i < _codeMask.size(); i++) out << (i % 32 ? " " : "\n    ") << (int) _codeMask[i] << ",";
+        out << "\n};\n\n";
+
+        out << "static const int " << _name << "_blockOf[] = {";
+        for (size_t i = 0; i < _blockOf.size(); i++) out << (i % 32 ? " " : "\n    ") << _blockOf[i] << ",";
+        out << "\n};\n\n";
+
+        out << "inline IntcodeNative::ExitReason " << _name << "_run(IntcodeNative::State& s)\n{\n";
+        out << "    long long* const m = s.memory;\n";
+        out << "    const long long size = s.memorySize;\n";
+        out << "    const unsigned long long* const codeBits = s.codeBits;\n";
+        out << "    const unsigned char* const stale = s.staleBlocks;\n";
+        out << "    long long rb = s.relativeBase, ip = s.instructionPointer;\n";
+        out << "    unsigned long long count = s.instructionCount;\n";
+        out << "    const unsigned long long limit = s.instructionLimit;\n";
+        out << "    IntcodeNative::ExitReason reason = IntcodeNative::EXIT_INTERPRET;\n\n";
+        out << "dispatch:\n";
+        out << "    if ((unsigned long long) ip < " << _blockOf.size() << "ULL && " << _name << "_blockOf[ip] >= 0 && stale["
+            << _name << "_blockOf[ip]]) goto leave;\n";
+        out << "    switch (ip)\n    {\n";
+        for (size_t i = 0; i < _instructions.size(); i++)
+        {
+            const long long address = _addresses[i];
+            const DecodedInstruction& instr = _instructions[i];
+            out << "    case " << address << ": L" << address << ": // " << describe(address, instr) << "\n";
+            out << "    {\n";
+            if (_blockStarts.count(address)) {
+                out << "        if (stale[" << _blockOf[address] << "]) " << leave(address) << "\n";
+            }
+            writeInstruction(out, address, instr);
+            out << "    }\n";
+
+            // Falling through only works into the next translated instruction
+            long long next = address + instr.length;
+            bool fallsThrough = instr.opCode != INPUT && instr.opCode != OUTPUT && instr.opCode != HALT;
+            if (fallsThrough && (i + 1 == _instructions.size() || _addresses[i + 1] != next)) {
+                out << "        ip = " << next << "; goto leave;\n";
+            }
+        }
+        out << "    default:\n        goto leave;\n    }\n\n";
+        out << "leave:\n";
+        out << "    s.relativeBase = rb;\n";
+        out << "    s.instructionPointer = ip;\n";
+        out << "    s.instructionCount = count;\n";
+        out << "    return reason;\n}\n\n";
+
+        out << "static const IntcodeNative::Program " << _name << " = {\n";
+        out << "    \"" << _name << "\", " << _name << "_image, " << _image.size() << ", "
+            << _name << "_codeMask, " << _name << "_blockOf, " << _blockStarts.size() << ", " << _name << "_run\n};\n\n";
+        out << "#pragma GCC diagnostic pop\n\n";
+        out << "#endif\n";
+    }
+
+    size_t instructionCount() { return _instructions.size(); }
+
+private:
+
+    // Instructions reachable from the entry points, numbered by basic block.
+    // Cells that are never run stay data, stores to them do not leave.
+    void collect()
+    {
+        IntcodeDisassembler program(_image);
+        int block = 0;
+        for (auto& entry : program.blocks())
+        {
+            _blockStarts.insert(entry.first);
+            for (long long address : entry.second.instructions)
+            {
+                const DecodedInstruction& instr = program.instructions().at(address).decoded;
+                for (int i = 0; i < instr.length; i++)
+                {
+                    _codeMask[address + i] = 1;
+                    _blockOf[address + i] = block;
+                }
+            }
+            block++;
+        }
+        for (auto& entry : program.instructions())
+        {
+            _labels.insert(entry.first);
+            _addresses.push_back(entry.first);
+            _instructions.push_back(entry.second.decoded);
+        }
+    }
+
+    std::string guard()
+    {
+        std::string guard;
+        for (char c : _name) guard += std::toupper((unsigned char) c);
+        return guard + "_HPP";
+    }
+
+    static std::string literal(long long value)
+    {
+        if (value == LLONG_MIN) return "(-9223372036854775807LL - 1)";
+        return "(" + std::to_string(value) + "LL)";
+    }
+
+    std::string describe(long long address, const DecodedInstruction& instr)
+    {
+        std::string text = std::to_string(_image[address]);
+        for (int i = 0; i < instr.length - 1; i++) text += " " + std::to_string(instr.operands[i]);
+        return text;
+    }
+
+    std::string leave(long long address)
+    {
+        return "{ ip = " + std::to_string(address) + "; goto leave; }";
+    }
+
+    // Emits bounds checks into out and returns the expression for the cell address
+    std::string operandAddress(std::ostream& out, long long address, const DecodedInstruction& instr, int i)
+    {
+        const long long operand = instr.operands[i];
+        switch (instr.modes[i])
+        {
+            case POSITION_MODE:
+                if (operand < 0) {
+                    out << "        " << leave(address) << "\n";
+                }
+                else {
+                    out << "        if (" << operand << "LL >= size) " << leave(address) << "\n";
+                }
+                return std::to_string(operand);
+
+            case IMMEDIATE_MODE:
+                return std::to_string(address + 1 + i);
+
+            default:
+            {
+                std::string name = "p" + std::to_string(i);
+                out << "        const long long " << name << " = rb + " << literal(operand) << ";\n";
+                out << "        if ((unsigned long long) " << name << " >= (unsigned long long) size) "
+                    << leave(address) << "\n";
+                return name;
+            }
+        };
+    }
+
+    std::string operandValue(std::ostream& out, long long address, const DecodedInstruction& instr, int i)
+    {
+        if (instr.modes[i] == IMMEDIATE_MODE) {
+            return literal(instr.operands[i]);
+        }
+        return "m[" + operandAddress(out, address, instr, i) + "]";
+    }
+
+    // Store, then leave when the cell is marked in the caller's code bitmap
+    void writeStore(std::ostream& out, long long next, const std::string& target, bool constant, long long targetAddress)
+    {
+        out << "        m[" << target << "] = v;\n";
+        std::string exit = "{ s.writeAddress = " + target + "; ip = " + std::to_string(next) +
+            "; reason = IntcodeNative::EXIT_CODE_WRITE; goto leave; }";
+        if (!constant) {
+            out << "        if ((codeBits[" << target << " >> 6] >> (" << target << " & 63)) & 1) " << exit << "\n";
+        }
+        else {
+            out << "        if (codeBits[" << (targetAddress >> 6) << "] & (1ULL << " << (targetAddress & 63) << ")) "
+                << exit << "\n";
+        }
+    }
+
+    std::string jump(long long target)
+    {
+        if (_labels.count(target)) return "goto L" + std::to_string(target) + ";";
+        return "{ ip = " + std::to_string(target) + "; goto dispatch; }";
+    }
+
+    void writeInstruction(std::ostream& out, long long address, const DecodedInstruction& instr)
+    {
+        const long long next = address + instr.length;
+        switch (instr.opCode)
+        {
+            case ADD: case MULT: case LESS_THAN: case EQUALS:
+            {
+                std::string a = operandValue(out, address, instr, 0),
+                    b = operandValue(out, address, instr, 1),
+                    target = operandAddress(out, address, instr, 2);
+                out << "        const long long v = ";
+                if (instr.opCode == ADD) out << "(long long) ((unsigned long long) " << a << " + (unsigned long long) " << b << ");\n";
+                if (instr.opCode == MULT) out << "(long long) ((unsigned long long) " << a << " * (unsigned long long) " << b << ");\n";
+                if (instr.opCode == LESS_THAN) out << "(" << a << " < " << b << ") ? 1 : 0;\n";
+                if (instr.opCode == EQUALS) out << "(" << a << " == " << b << ") ? 1 : 0;\n";
+                out << "        count++;\n";
+
+                bool constant = instr.modes[2] != RELATIVE_MODE;
+                long long targetAddress = instr.modes[2] == POSITION_MODE ? instr.operands[2] : address + 3;
+                writeStore(out, next, target, constant, targetAddress);
+                break;
+            }
+
+            case BASE_OP:
+            {
+                std::string a = operandValue(out, address, instr, 0);
+                out << "        count++;\n";
+                out << "        rb += " << a << ";\n";
+                break;
+            }
+
+            case JUMP_IF_TRUE: case JUMP_IF_FALSE:
+            {
+                // Every loop goes through a jump, checking the budget here bounds a run
+                out << "        if (count >= limit) { ip = " << address
+                    << "; reason = IntcodeNative::EXIT_BUDGET; goto leave; }\n";
+                std::string a = operandValue(out, address, instr, 0),
+                    b = operandValue(out, address, instr, 1);
+                out << "        count++;\n";
+                out << "        if (" << a << (instr.opCode == JUMP_IF_TRUE ? " != 0" : " == 0") << ") ";
+                if (instr.modes[1] == IMMEDIATE_MODE) out << jump(instr.operands[1]) << "\n";
+                else out << "{ ip = " << b << "; goto dispatch; }\n";
+                break;
+            }
+
+            default:
+                // INPUT, OUTPUT and HALT are executed by the interpreter
+                out << "        " << leave(address) << "\n";
+                break;
+        };
+    }
+
+    std::vector<long long> _image;
+    std::string _name;
+    std::vector<unsigned char> _codeMask;
+    std::vector<int> _blockOf;
+    std::set<long long> _blockStarts;
+    std::vector<long long> _addresses;
+    std::vector<DecodedInstruction> _instructions;
+    std::set<long long> _labels;
+};
+
+std::string defaultName(std::string path)
+{
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos) path = path.substr(slash + 1);
+    path = path.substr(0, path.find('.'));
+
+    std::string name;
+    for (char c : path) name += std::isalnum((unsigned char) c) ? c : '_';
+    if (name.empty() || std::isdigit((unsigned char) name[0])) name = "program_" + name;
+    return name + "_native";
+}
+
+int main (int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <program.txt> <output.hpp> [name]" << std::endl;
+        return 1;
+    }
+
+    std::vector<long long> intCode;
+    try {
+        intCode = IntcodeLoader::loadFile(argv[1]);
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    IntcodeTranslator translator(intCode, argc > 3 ? argv[3] : defaultName(argv[1]));
+    std::ofstream out(argv[2]);
+    if (!out)
+    {
+        std::cerr << "Unable to open " << argv[2] << std::endl;
+        return 1;
+    }
+    translator.write(out);
+    out.close();
+    if (!out)
+    {
+        std::cerr << "Unable to write " << argv[2] << std::endl;
+        return 1;
+    }
+    std::printf("Translated %zu instructions from %s into %s\n", translator.instructionCount(), argv[1], argv[2]);
+    return 0;
+}